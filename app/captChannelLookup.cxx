@@ -226,12 +226,11 @@ int main(int argc, char** argv) {
         else if (referenceGeometryId.IsValid()) {
             referenceChannelId = channelInfo.GetChannel(referenceGeometryId);
         }
-        int motherboard = channelInfo.GetMotherboard(referenceChannelId);
-        int asic = channelInfo.GetASIC(referenceChannelId);
-        int asicChan = channelInfo.GetASICChannel(referenceChannelId);
-        std::cout << "    Motherboard: " << motherboard
-                  << " ASIC: " << asic
-                  << " Channel: " << asicChan << std::endl;
+        CP::TChannelMap::Record record;
+        channelInfo.GetChannelRecord(referenceChannelId, record);
+        std::cout << "    Motherboard: " << record.fMotherboard
+                  << " ASIC: " << record.fASIC
+                  << " Channel: " << record.fASICChannel << std::endl;
         
     }
 
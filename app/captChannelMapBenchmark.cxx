@@ -0,0 +1,290 @@
+#include <TChannelInfo.hxx>
+#include <TChannelMap.hxx>
+#include <TValidityRange.hxx>
+#include <TEventContext.hxx>
+#include <TGeometryId.hxx>
+#include <TChannelId.hxx>
+#include <TTPCChannelId.hxx>
+#include <CaptGeomId.hxx>
+
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include <cstdlib>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+
+void usage() {
+    std::cout << "Usage: capt-channel-map-benchmark.exe [options]"
+              << std::endl
+              << std::endl
+              << "     Stress the CP::TChannelInfo lookups from several"
+              << std::endl
+              << "     threads while another thread changes the context,"
+              << std::endl
+              << "     and report the lookup rate.  The maps are built in"
+              << std::endl
+              << "     memory, so the database is not needed."
+              << std::endl
+              << std::endl
+              << "     -b           : Compare with std::map lookups instead"
+              << std::endl
+              << "     -t <threads> : The number of reader threads (4)"
+              << std::endl
+              << "     -n <passes>  : The passes over the map per thread (1000)"
+              << std::endl
+              << "     -w <wires>   : The number of wires per plane (332)"
+              << std::endl;
+}
+
+namespace {
+    // Make a context for a run in the CAPTAIN partition.
+    CP::TEventContext MakeContext(int run) {
+        CP::TEventContext context;
+        context.SetPartition(CP::TEventContext::kmCAPTAIN);
+        context.SetRun(run);
+        context.SetEvent(1);
+        context.SetTimeStamp(1);
+        return context;
+    }
+
+    // Build a map for a run with "wires" wires in each plane.  The channels
+    // are numbered sequentially around the TPC, and channel i is connected
+    // to wire i+shift, so maps with different shifts give a different
+    // answer for every channel.  The map is valid for the whole run.
+    std::shared_ptr<const CP::TChannelMap> MakeMap(int run, int wires,
+                                                   int shift) {
+        std::shared_ptr<CP::TChannelMap> channelMap(new CP::TChannelMap);
+        CP::TEventContext context = MakeContext(run);
+        channelMap->SetContext(context);
+        CP::TValidityRange validity;
+        validity.Reset(context);
+        channelMap->SetValidity(validity);
+        int total = 3*wires;
+        for (int i = 0; i<total; ++i) {
+            int wire = (i+shift)%total;
+            CP::TGeometryId gid
+                = CP::GeomId::Captain::Wire(wire/wires, wire%wires);
+            CP::TChannelId cid = CP::TTPCChannelId(1, i/64, i%64);
+            channelMap->AddChannel(cid, gid, wire,
+                                   wire/128, (wire/16)%8, wire%16);
+            channelMap->AddWire(gid, wire);
+        }
+        channelMap->Build();
+        return channelMap;
+    }
+
+    // Check that two records are the same.
+    bool SameRecord(const CP::TChannelMap::Record& a,
+                    const CP::TChannelMap::Record& b) {
+        return a.fChannel == b.fChannel
+            && a.fGeometry == b.fGeometry
+            && a.fWire == b.fWire
+            && a.fMotherboard == b.fMotherboard
+            && a.fASIC == b.fASIC
+            && a.fASICChannel == b.fASICChannel;
+    }
+
+    // The results for a reader thread.
+    struct Result {
+        Result() : fLookups(0), fErrors(0), fSeconds(0) {}
+        long fLookups;
+        long fErrors;
+        double fSeconds;
+    };
+
+    // Check that every record in a batch matches the same map.
+    bool SameMap(const std::vector<CP::TChannelMap::Record>& records,
+                 const std::vector<CP::TChannelMap::Record>& expected) {
+        for (std::size_t i = 0; i<records.size(); ++i) {
+            if (!SameRecord(records[i], expected[i])) return false;
+        }
+        return true;
+    }
+
+    // Look up every channel "passes" times through CP::TChannelInfo,
+    // alternating between single and batch lookups.  The context may change
+    // at any time, but every single lookup must match exactly one of the
+    // maps, and every batch lookup must match one of the maps as a whole.
+    // A result that mixes the maps means that a map was changed while it was
+    // being read.
+    void Reader(const std::vector<CP::TChannelId>& channels,
+                const std::vector<CP::TChannelMap::Record> (&expected)[2],
+                int passes, Result* result) {
+        CP::TChannelInfo& info = CP::TChannelInfo::Get();
+        int n = channels.size();
+        CP::TChannelMap::Record record;
+        std::vector<CP::TChannelMap::Record> records(n);
+        std::chrono::steady_clock::time_point start
+            = std::chrono::steady_clock::now();
+        for (int pass = 0; pass<passes; ++pass) {
+            result->fLookups += n;
+            if (pass%2 == 1) {
+                result->fErrors += info.GetChannelRecord(&channels[0], n,
+                                                         &records[0]);
+                if (SameMap(records, expected[0])) continue;
+                if (SameMap(records, expected[1])) continue;
+                ++result->fErrors;
+                continue;
+            }
+            for (int i = 0; i<n; ++i) {
+                if (!info.GetChannelRecord(channels[i], record)) {
+                    ++result->fErrors;
+                    continue;
+                }
+                if (SameRecord(record, expected[0][i])) continue;
+                if (SameRecord(record, expected[1][i])) continue;
+                ++result->fErrors;
+            }
+        }
+        std::chrono::duration<double> elapsed
+            = std::chrono::steady_clock::now() - start;
+        result->fSeconds = elapsed.count();
+    }
+
+    // Time "passes" lookups of every channel with "lookup" and print the
+    // rate.  This returns a checksum of the geometry so the lookups can't be
+    // optimized away.
+    long TimeLookups(const char* name,
+                     const std::vector<CP::TChannelId>& channels, int passes,
+                     std::function<CP::TGeometryId (CP::TChannelId)> lookup) {
+        long sum = 0;
+        std::chrono::steady_clock::time_point start
+            = std::chrono::steady_clock::now();
+        for (int pass = 0; pass<passes; ++pass) {
+            for (std::size_t i = 0; i<channels.size(); ++i) {
+                sum += lookup(channels[i]).AsInt();
+            }
+        }
+        std::chrono::duration<double> elapsed
+            = std::chrono::steady_clock::now() - start;
+        double lookups = 1.0*passes*channels.size();
+        std::cout << name << ": " << lookups/elapsed.count()
+                  << " lookups/s" << std::endl;
+        return sum;
+    }
+}
+
+int main(int argc, char** argv) {
+    int threads = 4;
+    int passes = 1000;
+    int wires = 332;
+    bool baseline = false;
+
+    // Process the options.
+    for (;;) {
+        int c = getopt(argc, argv, "bt:n:w:h");
+        if (c<0) break;
+        switch (c) {
+        case 'b': baseline = true; break;
+        case 't': std::istringstream(optarg) >> threads; break;
+        case 'n': std::istringstream(optarg) >> passes; break;
+        case 'w': std::istringstream(optarg) >> wires; break;
+        case 'h':
+        default:
+            usage();
+            exit(0);
+        }
+    }
+    if (threads < 1 || passes < 1 || wires < 1) {
+        usage();
+        exit(1);
+    }
+
+    // Two maps for different runs that connect each channel to a different
+    // wire.  They are added to the TChannelInfo cache so that changing the
+    // context between the runs doesn't need the database.
+    CP::TEventContext contexts[2] = {MakeContext(4400), MakeContext(4401)};
+    std::shared_ptr<const CP::TChannelMap> maps[2]
+        = {MakeMap(4400, wires, 0), MakeMap(4401, wires, 1)};
+    CP::TChannelInfo& info = CP::TChannelInfo::Get();
+    if (info.GetCacheCapacity() < 2) info.SetCacheCapacity(2);
+    info.AddChannelMap(maps[0]);
+    info.AddChannelMap(maps[1]);
+    info.SetContext(contexts[0]);
+
+    std::vector<CP::TChannelId> channels;
+    std::vector<CP::TChannelMap::Record> expected[2];
+    for (int i = 0; i<maps[0]->GetRecordCount(); ++i) {
+        CP::TChannelId cid = maps[0]->GetRecord(i).GetChannelId();
+        channels.push_back(cid);
+        for (int m = 0; m<2; ++m) {
+            expected[m].push_back(*maps[m]->FindChannel(cid));
+        }
+    }
+
+    if (baseline) {
+        // Compare the dense map lookups with the std::map that was used
+        // before CP::TChannelMap.
+        std::map<CP::TChannelId,CP::TGeometryId> stdMap;
+        for (std::size_t i = 0; i<channels.size(); ++i) {
+            stdMap[channels[i]] = expected[0][i].GetGeometryId();
+        }
+        const CP::TChannelMap& channelMap = *maps[0];
+        long sum = 0;
+        sum += TimeLookups("std::map", channels, passes,
+                           [&stdMap](CP::TChannelId cid) {
+                               return stdMap.find(cid)->second;
+                           });
+        sum += TimeLookups("TChannelMap", channels, passes,
+                           [&channelMap](CP::TChannelId cid) {
+                               return channelMap.FindChannel(cid)
+                                   ->GetGeometryId();
+                           });
+        sum += TimeLookups("TChannelInfo", channels, passes,
+                           [&info](CP::TChannelId cid) {
+                               return info.GetGeometry(cid);
+                           });
+        std::cout << "Checksum: " << sum << std::endl;
+        return 0;
+    }
+
+    std::atomic<bool> done(false);
+    long swaps = 0;
+    std::thread writer([&]() {
+            while (!done) {
+                info.SetContext(contexts[++swaps%2]);
+                std::this_thread::yield();
+            }
+        });
+
+    std::vector<Result> results(threads);
+    std::vector<std::thread> readers;
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+    for (int t = 0; t<threads; ++t) {
+        readers.push_back(std::thread(Reader, std::cref(channels),
+                                      std::cref(expected), passes,
+                                      &results[t]));
+    }
+    for (int t = 0; t<threads; ++t) readers[t].join();
+    std::chrono::duration<double> elapsed
+        = std::chrono::steady_clock::now() - start;
+    done = true;
+    writer.join();
+
+    long lookups = 0;
+    long errors = 0;
+    for (int t = 0; t<threads; ++t) {
+        std::cout << "Thread " << t << ": "
+                  << results[t].fLookups/results[t].fSeconds
+                  << " lookups/s" << std::endl;
+        lookups += results[t].fLookups;
+        errors += results[t].fErrors;
+    }
+    std::cout << "Total: " << lookups << " lookups in "
+              << elapsed.count() << " s (" << lookups/elapsed.count()
+              << " lookups/s) with " << swaps << " context changes"
+              << std::endl;
+
+    if (errors > 0) {
+        std::cout << "Found " << errors << " lookup errors" << std::endl;
+        return 1;
+    }
+    return 0;
+}
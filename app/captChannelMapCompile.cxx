@@ -0,0 +1,48 @@
+#include <TChannelMapFile.hxx>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+void usage() {
+    std::cout << "Usage: capt-channel-map-compile.exe <input> <output>"
+              << std::endl
+              << std::endl
+              << "     Compile a text CAPTCHANNELMAP file into the binary"
+              << std::endl
+              << "     format that can be mapped into memory."
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        usage();
+        return 1;
+    }
+
+    std::string input(argv[1]);
+    std::string output(argv[2]);
+
+    std::vector<CP::TChannelMap::Record> records;
+    if (!CP::TChannelMapFile::ReadText(input, records)) {
+        std::cout << "Unable to read " << input << std::endl;
+        return 1;
+    }
+
+    if (!CP::TChannelMapFile::WriteBinary(output, records)) {
+        std::cout << "Unable to write " << output << std::endl;
+        return 1;
+    }
+
+    // Check that the output can be read back.
+    CP::TChannelMapFile check;
+    if (!check.Open(output) || !check.IsMapped()
+        || check.GetRecordCount() != (int) records.size()) {
+        std::cout << "Unable to verify " << output << std::endl;
+        return 1;
+    }
+
+    std::cout << "Wrote " << records.size() << " channels to " << output
+              << std::endl;
+    return 0;
+}
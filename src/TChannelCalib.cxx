@@ -1,8 +1,6 @@
 #include "TChannelCalib.hxx"
 
 #include <TEvent.hxx>
-#include <THandle.hxx>
-#include <TRealDatum.hxx>
 #include <TEventFolder.hxx>
 #include <TCaptLog.hxx>
 #include <TChannelId.hxx>
@@ -11,130 +9,442 @@
 #include <TRuntimeParameters.hxx>
 #include <CaptGeomId.hxx>
 #include <TChannelInfo.hxx>
+#include <TGeometryInfo.hxx>
 #include <TTPCChannelId.hxx>
 
-#include <TTPC_Bad_Channel_Table.hxx>
-#include <TTPC_Channel_Calib_Table.hxx>
+#include "TChannelCalibSnapshot.hxx"
+#include "TChannelIndex.hxx"
+#include "TRealFFT.hxx"
+#include "TChannelMask.hxx"
+#include "TIgnoredWireList.hxx"
 
-#include <TResultSetHandle.hxx>
-#include <DatabaseUtils.hxx>
-#include <TDbi.hxx>
+#include <TTPC_Channel_Calib_Table.hxx>
 
 #include <sstream>
 #include <fstream>
-
-#define GET_CALIBRATION_STATUS
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <map>
+#include <cmath>
+#include <algorithm>
 
 namespace {
-    // This is slightly evil, but keep a "local" cache of the most recent
-    // calibration coefficients.  This prevents exposing the cache to the
-    // TChannelCalib users, and
-
-    // A cache for the bad channel table.
-    CP::TEventContext gTPCBadChannelContext;
-    CP::TEventContext gMCBadChannelContext;
-    typedef std::map<CP::TChannelId,int> TPCBadChannelMap;
-    TPCBadChannelMap gTPCBadChannels;
-    TPCBadChannelMap gMCBadChannels;
-    void UpdateTPCBadChannels() {
-        CP::TEvent* ev = CP::TEventFolder::GetCurrentEvent();
-        if (!ev) {
-            gTPCBadChannels.clear();
-            return;
+    // The ASIC shaping for a time in units of the peaking time.  This is
+    // the same function as GetPulseShape(), but it is written with selects
+    // instead of branches, and with pow() replaced by exp(k*log(x)), so
+    // that a loop over the samples can be vectorized when the compiler has
+    // vector versions of exp() and log() (e.g. glibc libmvec with
+    // -ffast-math).  Otherwise they are scalar calls.  Negative times give a
+    // zero, and zero is handled explicitly since log(0) is -inf and
+    // pow(0,0) is one.  The result agrees with the pow() version to within
+    // a few times 1E-16.
+    inline double PulseShapeKernel(double x, double riseShape,
+                                   double fallShape) {
+        double rising = (x < 1.0);
+        double k = rising*riseShape + (1.0-rising)*fallShape;
+        double arg = std::exp(k*std::log((x > 0.0)? x: 1.0));
+        arg = (x > 0.0)? arg: ((x == 0.0 && k == 0.0)? 1.0: 0.0);
+        double v = arg*std::exp(-arg);
+        return (arg<40)? 2.71828*v: 0.0;
+    }
+
+    // The ASIC shaping and its derivatives for a time.  The shaping is
+    // f = C*y*exp(-y) with y = (t/peakingTime)^k, where k is the rise shape
+    // before the peak and the fall shape after it, so df/dy is
+    // C*exp(-y)*(1-y).  This returns f, fills dFdT with df/dt, and, if
+    // dParams is not NULL, fills dParams[0], dParams[stride] and
+    // dParams[2*stride] with the derivatives with respect to the peaking
+    // time, the rise shape and the fall shape.
+    inline double PulseShapeGradientKernel(double t, double peakingTime,
+                                           double riseShape,
+                                           double fallShape,
+                                           double& dFdT, double* dParams,
+                                           int stride) {
+        dFdT = 0.0;
+        if (dParams) {
+            dParams[0] = 0.0;
+            dParams[stride] = 0.0;
+            dParams[2*stride] = 0.0;
         }
-        CP::TEventContext context = ev->GetContext();
-        if (context == gTPCBadChannelContext) {return;};
-        gTPCBadChannelContext = context;
-        gTPCBadChannels.clear();
-        // Get the bad channel table.
-	CP::TResultSetHandle<CP::TTPC_Bad_Channel_Table> chanTable(context);
-        Int_t numChannels(chanTable.GetNumRows());
-
-        for (int i = 0; i<numChannels; ++i) {
-            const CP::TTPC_Bad_Channel_Table* chanRow = chanTable.GetRow(i);
-            if (!chanRow) continue;
-            CP::TChannelId chanId = chanRow->GetChannelId();
-            gTPCBadChannels[chanId] = chanRow->GetChannelStatus();
+        if (t <= 0.0) return 0.0;
+        double x = t/peakingTime;
+        bool rising = (x < 1.0);
+        double k = rising? riseShape: fallShape;
+        double logX = std::log(x);
+        double arg = std::exp(k*logX);
+        if (arg >= 40) return 0.0;
+        double expArg = std::exp(-arg);
+        double dFdArg = 2.71828*expArg*(1.0-arg);
+        dFdT = dFdArg*k*arg/t;
+        if (dParams) {
+            dParams[0] = -dFdArg*k*arg/peakingTime;
+            dParams[rising? stride: 2*stride] = dFdArg*arg*logX;
         }
-        
-        CaptLog("Bad channel table update: " << gTPCBadChannelContext);
-        
+        return 2.71828*arg*expArg;
     }
 
-    void UpdateMCBadChannels() {
-        CP::TEvent* ev = CP::TEventFolder::GetCurrentEvent();
-        if (!ev) {
-            gMCBadChannels.clear();
-            return;
+    // Fill the shaping for "n" uniformly spaced times.
+    void FillPulseShape(double peakingTime, double riseShape,
+                        double fallShape, double t0, double dt,
+                        int n, double* values) {
+        double x0 = t0/peakingTime;
+        double dx = dt/peakingTime;
+        for (int i = 0; i<n; ++i) {
+            values[i] = PulseShapeKernel(x0 + i*dx, riseShape, fallShape);
         }
-        CP::TEventContext context = ev->GetContext();
-        if (context == gMCBadChannelContext) return;
-        CaptLog("Bad channel table update " << context);
-        
-        gMCBadChannelContext = context;
-        gMCBadChannels.clear();
-
-        // Make sure the context has a valid time.  Use the current time!
-        if (context.GetTimeStamp() == CP::TEventContext::Invalid) {
-            std::time_t t2 = std::time(0);
-            context.SetTimeStamp(t2);
-        }
-
-        // Get the bad channel table.
-	CP::TResultSetHandle<CP::TTPC_Bad_Channel_Table> chanTable(context);
-        Int_t numChannels(chanTable.GetNumRows());
+    }
 
-        for (int i = 0; i<numChannels; ++i) {
-            const CP::TTPC_Bad_Channel_Table* chanRow = chanTable.GetRow(i);
-            if (!chanRow) continue;
-	    //chanRow->PrintMC();
-            CP::TChannelId chanId = chanRow->GetChannelMCId();
-            gMCBadChannels[chanId] = chanRow->GetChannelStatus();
+    // Fill the shaping for "n" arbitrary times.
+    void FillPulseShape(double peakingTime, double riseShape,
+                        double fallShape, const double* times,
+                        int n, double* values) {
+        double scale = 1.0/peakingTime;
+        for (int i = 0; i<n; ++i) {
+            values[i] = PulseShapeKernel(times[i]*scale, riseShape, fallShape);
         }
-        
     }
 
-    // A cache for the tpc pulse gain and shape calibration table
-    CP::TEventContext gTPCChannelCalibContext;
-    typedef std::map<CP::TChannelId,int> TPCChannelCalibMap;
-    TPCChannelCalibMap gTPCChannelCalib;
-    
-    // The list of wires to be ignored
-    std::set< std::pair<int,int> > gIgnoredWireSet;
-    void UpdateIgnoredWireSet() {
-        if (!CP::TRuntimeParameters::Get().HasParameter(
-                "captChanInfo.wire.ignore.file")) {
-            CaptError("File parameter is missing");
-            return;
+    // Convert ADC samples into charge, and optionally fill the sample times.
+    // The loops are kept simple so that they can be vectorized.
+    void FillCharge(const short* adc, int n, double pedestal, double scale,
+                    double t0, double dt, double* charge, double* times) {
+        for (int i = 0; i<n; ++i) charge[i] = (adc[i] - pedestal)*scale;
+        if (!times) return;
+        for (int i = 0; i<n; ++i) times[i] = t0 + i*dt;
+    }
+
+    // A cache of sampled pulse shape templates.  Channels with the same
+    // shaping parameters (after quantization) share a template, so the
+    // template is only calculated once.  The templates start at zero and
+    // are sampled until the shaping vanishes.
+    struct PulseShapeTemplates {
+        // The quantized shaping parameters and sample step for a template.
+        struct Key {
+            long fPeakTime;
+            long fRise;
+            long fFall;
+            long fStep;
+            bool operator < (const Key& rhs) const {
+                if (fPeakTime != rhs.fPeakTime) {
+                    return fPeakTime < rhs.fPeakTime;
+                }
+                if (fRise != rhs.fRise) return fRise < rhs.fRise;
+                if (fFall != rhs.fFall) return fFall < rhs.fFall;
+                return fStep < rhs.fStep;
+            }
+        };
+        PulseShapeTemplates()
+            : fPeakTimeStep(0), fShapeStep(0) {}
+        // Find the template for the shaping parameters, and build it if it
+        // doesn't exist.
+        int Find(double peakingTime, double riseShape, double fallShape,
+                 double step) {
+            if (fPeakTimeStep <= 0.0) {
+                fPeakTimeStep = 5*unit::ns;
+                fShapeStep = 0.01;
+                CP::TRuntimeParameters& param = CP::TRuntimeParameters::Get();
+                if (param.HasParameter("captChanInfo.template.peakTime")) {
+                    fPeakTimeStep = param.GetParameterD(
+                        "captChanInfo.template.peakTime")*unit::ns;
+                }
+                if (param.HasParameter("captChanInfo.template.shape")) {
+                    fShapeStep = param.GetParameterD(
+                        "captChanInfo.template.shape");
+                }
+            }
+            Key key;
+            key.fPeakTime = std::max(1L,std::lround(peakingTime/fPeakTimeStep));
+            key.fRise = std::max(1L,std::lround(riseShape/fShapeStep));
+            key.fFall = std::max(1L,std::lround(fallShape/fShapeStep));
+            key.fStep = std::max(1L,std::lround(step/(0.001*unit::ns)));
+            std::map<Key,int>::iterator k = fKeys.find(key);
+            if (k != fKeys.end()) return k->second;
+
+            // Build the template using the quantized parameters.
+            double peak = key.fPeakTime*fPeakTimeStep;
+            double rise = key.fRise*fShapeStep;
+            double fall = key.fFall*fShapeStep;
+            double dt = key.fStep*0.001*unit::ns;
+            double last = peak*std::pow(40.0, 1.0/fall);
+            double samples = last/dt;
+            int n = (samples < 65534)? 2 + (int) samples: 65536;
+            int id = fTemplates.size();
+            fTemplates.push_back(std::vector<double>(n));
+            FillPulseShape(peak, rise, fall, 0.0, dt, n, &fTemplates.back()[0]);
+            fKeys[key] = id;
+            return id;
+        }
+        // The response kernels for a template and a waveform length.  The
+        // spectrum is only filled when it is requested.
+        struct Kernel {
+            std::vector<double> fTime;
+            std::vector< std::complex<double> > fSpectrum;
+        };
+        // Find the kernel for a template and waveform length, and build the
+        // time domain kernel if it doesn't exist.
+        Kernel& FindKernel(int templateId, int samples) {
+            std::pair<int,int> key(templateId, samples);
+            std::map< std::pair<int,int>, Kernel >::iterator k
+                = fKernels.find(key);
+            if (k != fKernels.end()) return k->second;
+            Kernel& kernel = fKernels[key];
+            const std::vector<double>& shape = fTemplates[templateId];
+            kernel.fTime.assign(samples, 0.0);
+            int n = std::min(samples, (int) shape.size());
+            std::copy(shape.begin(), shape.begin()+n, kernel.fTime.begin());
+            return kernel;
+        }
+        // Find the kernel, and make sure the spectrum has been calculated.
+        Kernel& FindSpectrum(int templateId, int samples) {
+            Kernel& kernel = FindKernel(templateId, samples);
+            if (!kernel.fSpectrum.empty()) return kernel;
+            std::map<int,CP::TRealFFT>::iterator f = fFFT.find(samples);
+            if (f == fFFT.end()) {
+                f = fFFT.insert(
+                    std::make_pair(samples, CP::TRealFFT(samples))).first;
+            }
+            kernel.fSpectrum.resize(f->second.GetSpectrumSize());
+            f->second.Forward(&kernel.fTime[0], &kernel.fSpectrum[0]);
+            return kernel;
+        }
+        // Remove all of the templates and kernels.  The FFT tables only
+        // depend on the length, so they are kept.
+        void Clear() {
+            fKeys.clear();
+            fTemplates.clear();
+            fKernels.clear();
         }
-        std::string file
-            = CP::TRuntimeParameters::Get().GetParameterS(
-                "captChanInfo.wire.ignore.file");
-        const char* root = std::getenv("CAPTCHANINFOROOT");
-        if (!root) {
-            CaptError("Missing CAPTCHANINFOROOT environment variable");
-            return;
+        // The approximate memory used by the templates and kernels.
+        std::size_t GetMemoryUsage() const {
+            std::size_t size = fKeys.size()*(sizeof(Key)+sizeof(int));
+            for (std::size_t i = 0; i<fTemplates.size(); ++i) {
+                size += sizeof(fTemplates[i]);
+                size += fTemplates[i].capacity()*sizeof(double);
+            }
+            for (std::map< std::pair<int,int>, Kernel >::const_iterator k
+                     = fKernels.begin();
+                 k != fKernels.end(); ++k) {
+                size += sizeof(*k);
+                size += k->second.fTime.capacity()*sizeof(double);
+                size += k->second.fSpectrum.capacity()
+                    *sizeof(std::complex<double>);
+            }
+            return size;
         }
-        file = std::string(root) + "/parameters/" + file;
-        gIgnoredWireSet.clear();
-        gIgnoredWireSet.insert(std::make_pair(1,1));
-        std::ifstream input(file.c_str());
-        if (!input.is_open()) {
-            CaptError("Unable to read " << file);
-            std::exit(1);
+        // The quantization of the peaking time.
+        double fPeakTimeStep;
+        // The quantization of the rise and fall shapes.
+        double fShapeStep;
+        // The map from the quantized parameters to the template.
+        std::map<Key,int> fKeys;
+        // The templates.  A deque is used so that adding a template doesn't
+        // move the existing ones, and references stay valid.
+        std::deque< std::vector<double> > fTemplates;
+        // The response kernels for each template and waveform length.
+        std::map< std::pair<int,int>, Kernel > fKernels;
+        // The FFT for each waveform length.
+        std::map<int,CP::TRealFFT> fFFT;
+    };
+    PulseShapeTemplates gPulseShapeTemplates;
+
+    // The calibration snapshot for the current event.  A new snapshot is
+    // made when the event (or its context) changes.  The tables are shared
+    // with the previous snapshot while the context is in the same validity
+    // range, so this doesn't access the database for every event.
+    struct CurrentSnapshot {
+        CurrentSnapshot() : fEvent(NULL) {}
+        // The event and context used to make the snapshot.
+        const CP::TEvent* fEvent;
+        CP::TEventContext fContext;
+        // The snapshot for the event.
+        std::shared_ptr<const CP::TChannelCalibSnapshot> fSnapshot;
+    };
+    CurrentSnapshot gCurrentSnapshot;
+
+    // Get the calibration snapshot for the current event.  This throws an
+    // exception if there isn't an event.
+    const CP::TChannelCalibSnapshot& GetCurrentSnapshot() {
+        CP::TEvent* ev = CP::TEventFolder::GetCurrentEvent();
+        if (!ev) {
+            CaptError("No event is loaded so context cannot be set.");
+            throw CP::EChannelCalibUnknownType();
         }
-        
-        CaptLog("Read ignored wires from " << file);
-        
-        std::string line;
-        while (std::getline(input,line)) {
-            line = line.substr(0,line.find("#"));
-            if (line.empty()) continue;
-            std::istringstream parseLine(line);
-            std::pair<int,int> wire;
-            parseLine >> wire.first >> wire.second;
-            gIgnoredWireSet.insert(wire);
+        CurrentSnapshot& current = gCurrentSnapshot;
+        if (current.fSnapshot
+            && ev == current.fEvent
+            && ev->GetContext() == current.fContext) {
+            return *current.fSnapshot;
         }
+        current.fEvent = ev;
+        current.fContext = ev->GetContext();
+        current.fSnapshot.reset(new CP::TChannelCalibSnapshot(*ev));
+        return *current.fSnapshot;
+    }
+
+    // Check that the constants for a channel are available.  This throws an
+    // exception for an unknown MC channel.
+    void CheckKnownChannel(const CP::TChannelCalibSnapshot& snapshot,
+                           CP::TChannelId id) {
+        if (snapshot.IsKnownChannel(id)) return;
+        CaptWarn("Unknown channel: " << id);
+        throw CP::EChannelCalibUnknownType();
+    }
+
+    // Get the snapshot for the current event, and check that the constants
+    // for a channel are available.  This throws an exception for an unknown
+    // MC channel.
+    const CP::TChannelCalibSnapshot& GetKnownSnapshot(CP::TChannelId id) {
+        const CP::TChannelCalibSnapshot& snapshot = GetCurrentSnapshot();
+        CheckKnownChannel(snapshot, id);
+        return snapshot;
+    }
+
+    // Check that an MC electronics simulation constant was found in the
+    // event for a channel.  This throws an exception if it's missing.
+    void CheckMCConstant(const CP::TChannelCalibSnapshot& snapshot,
+                         int datum, CP::TChannelId id) {
+        if (snapshot.HasMCConstant(datum, id)) return;
+        CaptError("Missing ~/truth/elecSimple/"
+                  << CP::TChannelCalibSnapshot::GetMCConstantName(datum));
+        throw CP::EChannelCalibUnknownType();
+    }
+
+    // Get the snapshot for the current event, and check that an MC
+    // electronics simulation constant is available for a channel.
+    const CP::TChannelCalibSnapshot& GetKnownSnapshot(CP::TChannelId id,
+                                                      int datum) {
+        const CP::TChannelCalibSnapshot& snapshot = GetKnownSnapshot(id);
+        CheckMCConstant(snapshot, datum, id);
+        return snapshot;
+    }
+
+    // Check that the MC electronics simulation constants flagged in
+    // "datums" (one bit per datum) are available for a known channel.  The
+    // constants are the same for every channel of a type, so the types that
+    // have been checked are flagged in "checked" (one bit per type) and
+    // are not checked again.  The TPC channels always have their constants.
+    void CheckMCConstants(const CP::TChannelCalibSnapshot& snapshot,
+                          CP::TChannelId id, unsigned int& checked,
+                          unsigned int datums = ~0u) {
+        if (!id.IsMCChannel()) return;
+        unsigned int type
+            = 1u << CP::TChannelCalibSnapshot::GetMCChannelType(id);
+        if (checked & type) return;
+        for (int d = 0; d<CP::TChannelCalibSnapshot::kDatums; ++d) {
+            if (datums & (1u << d)) CheckMCConstant(snapshot, d, id);
+        }
+        checked |= type;
+    }
+
+    // Check that the MC gain and pulse shape are available for a channel.
+    void CheckMCShape(const CP::TChannelCalibSnapshot& snapshot,
+                      CP::TChannelId id) {
+        CheckMCConstant(snapshot, CP::TChannelCalibSnapshot::kGain, id);
+        CheckMCConstant(snapshot, CP::TChannelCalibSnapshot::kShape, id);
+        CheckMCConstant(snapshot, CP::TChannelCalibSnapshot::kShapeRise, id);
+        CheckMCConstant(snapshot, CP::TChannelCalibSnapshot::kShapeFall, id);
+    }
+
+    // The pulse shape template for each slot of the TPC calibration table.
+    // The templates are found when a template is first requested, and are
+    // cleared when the table changes.
+    struct TemplateIds {
+        // The table used to fill the template ids.
+        std::shared_ptr<const CP::TChannelCalibSnapshot::CalibTable> fCalib;
+        // The template for each slot.
+        std::vector<int> fTemplateId;
+    };
+    TemplateIds gTemplateIds;
+
+    // Fill the pulse shape template for each slot of the calibration table
+    // if it hasn't been done since the table was loaded.  Only the slots
+    // with a row in the table get their own template.  The holes in the
+    // index box share the template for the default slot, so they don't
+    // build templates that no channel will use.
+    const TemplateIds& UpdateTemplateIds() {
+        const CP::TChannelCalibSnapshot& snapshot = GetCurrentSnapshot();
+        TemplateIds& ids = gTemplateIds;
+        if (ids.fCalib != snapshot.GetCalibTable()) {
+            ids.fCalib = snapshot.GetCalibTable();
+            ids.fTemplateId.clear();
+            gPulseShapeTemplates.Clear();
+        }
+        if (!ids.fTemplateId.empty()) return ids;
+        const CP::TChannelCalibSnapshot::CalibTable& calib = *ids.fCalib;
+        int slots = calib.fPeakTime.size();
+        int defaultSlot = slots - 1;
+        ids.fTemplateId.resize(slots);
+        ids.fTemplateId[defaultSlot]
+            = gPulseShapeTemplates.Find(
+                calib.fPeakTime[defaultSlot],
+                calib.fRise[defaultSlot],
+                calib.fFall[defaultSlot],
+                snapshot.GetTimeConstant(
+                    calib.fIndex.GetChannel(defaultSlot),1));
+        for (int slot = 0; slot<defaultSlot; ++slot) {
+            if (!calib.fFound[slot]) {
+                ids.fTemplateId[slot] = ids.fTemplateId[defaultSlot];
+                continue;
+            }
+            CP::TChannelId cid = calib.fIndex.GetChannel(slot);
+            ids.fTemplateId[slot]
+                = gPulseShapeTemplates.Find(
+                    calib.fPeakTime[slot],
+                    calib.fRise[slot],
+                    calib.fFall[slot],
+                    snapshot.GetTimeConstant(cid,1));
+        }
+        return ids;
+    }
+
+    // A cache for the mask of usable channels.  The mask is rebuilt when
+    // the status table or the channel map changes.
+    struct UsableChannels {
+        UsableChannels() : fGeneration(0), fEpoch(-1) {}
+        // Incremented each time the mask is built.
+        int fGeneration;
+        // The epoch of the ignored wire list used to build the mask.
+        int fEpoch;
+        // The status table used to build the mask.
+        std::shared_ptr<const CP::TChannelCalibSnapshot::StatusTable> fStatus;
+        // The channel map used to build the mask.
+        std::shared_ptr<const CP::TChannelMap> fMap;
+        // The usable channels.
+        CP::TChannelMask fMask;
+    };
+    UsableChannels gUsableChannels;
+
+    // A cache of the calibration records for every channel in the detector.
+    // The records are rebuilt when the mask of usable channels is rebuilt,
+    // or the calibration table changes.  The MC constants are saved in the
+    // event, so the MC records are also rebuilt for each snapshot.
+    struct DetectorRecords {
+        DetectorRecords() : fUsableGeneration(-1) {}
+        // The generation of the usable channel mask.
+        int fUsableGeneration;
+        // The calibration table used to fill the records.
+        std::shared_ptr<const CP::TChannelCalibSnapshot::CalibTable> fCalib;
+        // The snapshot used to fill the MC records.
+        std::shared_ptr<const CP::TChannelCalibSnapshot> fSnapshot;
+        // The record for each slot of the usable channel mask.
+        std::vector<CP::TChannelCalibSnapshot::Record> fRecords;
+    };
+    DetectorRecords gDetectorRecords;
+
+    // Get the run for the current event, or -1 if there isn't an event.
+    int GetCurrentRun() {
+        CP::TEvent* ev = CP::TEventFolder::GetCurrentEvent();
+        if (!ev) return -1;
+        return ev->GetContext().GetRun();
+    }
+
+    // Check if a geometry object is a wire that isn't ignored for a run.
+    bool IsGoodWireForRun(CP::TGeometryId geomId, int run) {
+        if (!geomId.IsValid()) return false;
+        if (!CP::GeomId::Captain::IsWire(geomId)) return false;
+        return !CP::TIgnoredWireList::Get().IsIgnored(geomId, run);
     }
 }
 
@@ -152,6 +462,157 @@ bool CP::TChannelCalib::IsGoodChannel(CP::TChannelId id) {
     return true;
 }
 
+const CP::TChannelCalibSnapshot& CP::TChannelCalib::GetSnapshot() {
+    return GetCurrentSnapshot();
+}
+
+const CP::TChannelMask& CP::TChannelCalib::GetUsableChannels() {
+    const CP::TChannelCalibSnapshot& snapshot = GetCurrentSnapshot();
+    const CP::TEventContext& context = snapshot.GetContext();
+    bool mc = context.IsMC();
+    const StatusTable& status = snapshot.GetDetectorStatus();
+    std::shared_ptr<const CP::TChannelMap> channelMap
+        = CP::TChannelInfo::Get().GetChannelMap(context);
+    int run = context.GetRun();
+    int epoch = CP::TIgnoredWireList::Get().GetEpoch(run);
+
+    UsableChannels& usable = gUsableChannels;
+    if (usable.fStatus == snapshot.GetStatusTable()
+        && usable.fMap == channelMap
+        && usable.fEpoch == epoch) {
+        return usable.fMask;
+    }
+    usable.fStatus = snapshot.GetStatusTable();
+    usable.fMap = channelMap;
+    usable.fEpoch = epoch;
+    ++usable.fGeneration;
+
+    // Cover every channel in the status table, and every channel in the
+    // detector.  The MC wires are generated, and the TPC channels come from
+    // the channel map.
+    CP::TChannelIndex index = status.fIndex;
+    if (mc) {
+        for (int plane = 0; plane < 3; ++plane) {
+            int wires = CP::TGeometryInfo::Get().GetWireCount(plane);
+            for (int wire = 0; wire < wires; ++wire) {
+                index.Include(CP::TMCChannelId(0,plane,wire));
+            }
+        }
+    }
+    else {
+        for (int i = 0; i < channelMap->GetRecordCount(); ++i) {
+            index.Include(channelMap->GetRecord(i).GetChannelId());
+        }
+    }
+
+    // Find the wire for every slot in one batch.  Slots that aren't
+    // attached to a wire get an invalid geometry, and are not usable.
+    int slots = index.GetSize();
+    std::vector<CP::TChannelId> ids(slots);
+    for (int slot = 0; slot < slots; ++slot) ids[slot] = index.GetChannel(slot);
+    std::vector<CP::TGeometryId> geomIds(slots);
+    if (slots > 0) channelMap->GetGeometry(&ids[0], slots, &geomIds[0], NULL);
+
+    usable.fMask.Reset(index);
+    int good = 0;
+    for (int slot = 0; slot < slots; ++slot) {
+        int channelStatus = status.GetStatus(ids[slot]);
+        channelStatus &= ~(TTPC_Channel_Calib_Table::kLowGain
+                           |TTPC_Channel_Calib_Table::kHighGain
+                           |TTPC_Channel_Calib_Table::kBadPeak
+                           |TTPC_Channel_Calib_Table::kBadFit);
+        if (channelStatus != 0) continue;
+        if (!IsGoodWireForRun(geomIds[slot], run)) continue;
+        usable.fMask.Set(slot);
+        ++good;
+    }
+
+    CaptLog("Usable channel mask update: " << context
+            << " (" << good << " of " << slots << " slots)");
+
+    return usable.fMask;
+}
+
+const std::vector<CP::TChannelCalib::CalibRecord>&
+CP::TChannelCalib::GetDetectorCalibRecords() {
+    const CP::TChannelMask& mask = GetUsableChannels();
+    const CP::TChannelCalibSnapshot& snapshot = GetCurrentSnapshot();
+    std::shared_ptr<const CP::TChannelCalibSnapshot> mcSnapshot;
+    if (snapshot.GetContext().IsMC()) mcSnapshot = gCurrentSnapshot.fSnapshot;
+
+    DetectorRecords& detector = gDetectorRecords;
+    if (detector.fUsableGeneration == gUsableChannels.fGeneration
+        && detector.fCalib == snapshot.GetCalibTable()
+        && detector.fSnapshot == mcSnapshot) {
+        return detector.fRecords;
+    }
+    detector.fCalib = snapshot.GetCalibTable();
+    detector.fSnapshot = mcSnapshot;
+
+    // Clear the key first so a missing MC constant doesn't leave a partly
+    // filled set of records in the cache.
+    detector.fUsableGeneration = -1;
+    const CP::TChannelIndex& index = mask.GetIndex();
+    int slots = index.GetSize();
+    detector.fRecords.resize(slots);
+    unsigned int checked = 0;
+    for (int slot = 0; slot < slots; ++slot) {
+        CP::TChannelId id = index.GetChannel(slot);
+        CheckKnownChannel(snapshot, id);
+        CheckMCConstants(snapshot, id, checked);
+        snapshot.GetCalibRecord(id, detector.fRecords[slot]);
+    }
+    detector.fUsableGeneration = gUsableChannels.fGeneration;
+    return detector.fRecords;
+}
+
+void CP::TChannelCalib::GetCalibRecord(CP::TChannelId id,
+                                       CalibRecord& record) {
+    const CP::TChannelCalibSnapshot& snapshot = GetKnownSnapshot(id);
+    unsigned int checked = 0;
+    CheckMCConstants(snapshot, id, checked);
+    snapshot.GetCalibRecord(id, record);
+}
+
+void CP::TChannelCalib::GetCalibRecord(const CP::TChannelId* ids, int n,
+                                       CalibRecord* records) {
+    if (n < 1) return;
+    const CP::TChannelCalibSnapshot& snapshot = GetCurrentSnapshot();
+    unsigned int checked = 0;
+    for (int i = 0; i<n; ++i) {
+        CheckKnownChannel(snapshot, ids[i]);
+        CheckMCConstants(snapshot, ids[i], checked);
+    }
+    snapshot.GetCalibRecord(ids, n, records);
+}
+
+void CP::TChannelCalib::GetCalibRecord(
+    CP::TChannelId id, CalibRecord& record,
+    CP::TChannelCalibSnapshot::Fallback fallback) {
+    const CP::TChannelCalibSnapshot& snapshot = GetKnownSnapshot(id);
+    unsigned int checked = 0;
+    CheckMCConstants(snapshot, id, checked);
+    snapshot.GetCalibRecord(id, record, fallback);
+}
+
+CP::TChannelCalib::CalibAverage
+CP::TChannelCalib::GetASICAverage(CP::TChannelId id) {
+    const CP::TChannelCalibSnapshot& snapshot = GetKnownSnapshot(id);
+    CheckMCShape(snapshot, id);
+    return snapshot.GetASICAverage(id);
+}
+
+CP::TChannelCalib::CalibAverage
+CP::TChannelCalib::GetMotherboardAverage(CP::TChannelId id) {
+    const CP::TChannelCalibSnapshot& snapshot = GetKnownSnapshot(id);
+    CheckMCShape(snapshot, id);
+    return snapshot.GetMotherboardAverage(id);
+}
+
+bool CP::TChannelCalib::IsUsableChannel(CP::TChannelId id) {
+    return GetUsableChannels().Test(id);
+}
+
 bool CP::TChannelCalib::IsGoodWire(CP::TChannelId id) {
     /// Get the geometry id for the current wire.
     CP::TGeometryId geomId = CP::TChannelInfo::Get().GetGeometry(id);
@@ -159,13 +620,7 @@ bool CP::TChannelCalib::IsGoodWire(CP::TChannelId id) {
 }
 
 bool CP::TChannelCalib::IsGoodWire(CP::TGeometryId geomId) {
-    if (!geomId.IsValid()) return false;
-    if (!CP::GeomId::Captain::IsWire(geomId)) return false;
-    if (gIgnoredWireSet.empty()) UpdateIgnoredWireSet();
-    std::pair<int,int> wire(CP::GeomId::Captain::GetWirePlane(geomId),
-                            CP::GeomId::Captain::GetWireNumber(geomId));
-    if (gIgnoredWireSet.find(wire) != gIgnoredWireSet.end()) return false;
-    return true;
+    return IsGoodWireForRun(geomId, GetCurrentRun());
 }
 
 bool CP::TChannelCalib::IsBipolarSignal(CP::TChannelId id) {
@@ -232,280 +687,56 @@ bool CP::TChannelCalib::IsBipolarSignal(CP::TChannelId id) {
 }
 
 int CP::TChannelCalib::GetChannelStatus(CP::TChannelId id) {
-    if (id.IsMCChannel()) {
-	//return 0;
-	TPCBadChannelMap::iterator val = gMCBadChannels.find(id);
-	UpdateMCBadChannels();
+    // If there isn't an event, then all of the MC channels are good.
+    if (id.IsMCChannel() && !CP::TEventFolder::GetCurrentEvent()) return 0;
+    return GetCurrentSnapshot().GetChannelStatus(id);
+}
 
-	if (val != gMCBadChannels.end()) return val->second;
-	else return 0;
-    }
-    else {
-	UpdateTPCBadChannels();
-	TPCBadChannelMap::iterator val = gTPCBadChannels.find(id);
-	if (val != gTPCBadChannels.end()) return val->second;
-
-#ifdef GET_CALIBRATION_STATUS
-	// Get the status of the calibration fit for this channel.  This should
-	// only be enabled after the calibration fitting routine has settled on a
-	// good set of statis bits.
-    
-	CP::TEvent* ev = CP::TEventFolder::GetCurrentEvent();
-	if (!ev) {
-	    CaptError("No event is loaded so context cannot be set.");
-	    throw EChannelCalibUnknownType();
-	}
-
-	CP::TEventContext context = ev->GetContext();
-	CP::TResultSetHandle<CP::TTPC_Channel_Calib_Table> table(context);
-	const CP::TTPC_Channel_Calib_Table* row = table.GetRowByIndex(id.AsUInt());
-	
-	// Empty table, so all good.
-	if (table.GetNumRows()<10) return 0;
-	
-	if (!row) return CP::TTPC_Channel_Calib_Table::kNoSignal;
-    
-	return row->GetChannelStatus();
-#else
-	return 0;
-#endif
-    }
+const CP::TChannelCalib::StatusTable& CP::TChannelCalib::GetDetectorStatus() {
+    return GetCurrentSnapshot().GetDetectorStatus();
 }
 
 double CP::TChannelCalib::GetGainConstant(CP::TChannelId id, int order) {
-    CP::TEvent* ev = CP::TEventFolder::GetCurrentEvent();
-    if (!ev) {
-        CaptError("No event is loaded so context cannot be set.");
-        throw EChannelCalibUnknownType();
+    const CP::TChannelCalibSnapshot& snapshot = GetKnownSnapshot(id);
+    if (order == 1) {
+        CheckMCConstant(snapshot, CP::TChannelCalibSnapshot::kGain, id);
     }
-    CP::TEventContext context = ev->GetContext();
-        
-    if (id.IsMCChannel()) {
-        TMCChannelId mc(id);
-
-        int index = -1;
-        if (mc.GetType() == 0) index = mc.GetSequence();
-        else if (mc.GetType() == 1) index = 3;
-        else {
-            CaptWarn("Unknown channel: " << id);
-            throw CP::EChannelCalibUnknownType();
-        }
-            
-        if (order == 1) {
-            // Get the gain
-            CP::THandle<CP::TRealDatum> gainVect
-                = ev->Get<CP::TRealDatum>("~/truth/elecSimple/gain");
-            return (*gainVect)[index];
-        }
-
-        return 0.0;
-    }
-
-    CP::TResultSetHandle<CP::TTPC_Channel_Calib_Table> table(context);
-    const CP::TTPC_Channel_Calib_Table* row = table.GetRowByIndex(id.AsUInt());
-
-    if (!row) {
-        CaptWarn("Unknown channel: " << id);
-        if (order == 1) return (14.0*unit::mV/unit::fC);
-        return 0.0;
-    }
-
-    if (order == 1) return row->GetASICGain()*unit::mV/unit::fC;
-    return 0.0;
+    return snapshot.GetGainConstant(id,order);
 }
 
 double CP::TChannelCalib::GetAveragePulseShapePeakTime(CP::TChannelId id,
                                                        int order) {
-    CP::TEvent* ev = CP::TEventFolder::GetCurrentEvent();
-    if (!ev) {
-        CaptError("No event is loaded so context cannot be set.");
-        throw EChannelCalibUnknownType();
-    }
-    CP::TEventContext context = ev->GetContext();
-
-    if (id.IsMCChannel()) return GetPulseShapePeakTime(id,order);
-
-    CP::TResultSetHandle<CP::TTPC_Channel_Calib_Table> table(context);
-    
-    Int_t numChannels(table.GetNumRows());
-
-    double peakTime = 0.0;
-    double count = 0.0;
-    for (int i = 0; i<numChannels; ++i) {
-        const CP::TTPC_Channel_Calib_Table* row = table.GetRow(i);
-        peakTime += row->GetASICPeakTime()*unit::ns;
-        count += 1.0;
-    }
-    peakTime /= count;
-    
-    return peakTime;
+    return GetKnownSnapshot(
+        id, CP::TChannelCalibSnapshot::kShape).GetAveragePulseShapePeakTime(id);
 }
 
 double CP::TChannelCalib::GetPulseShapePeakTime(CP::TChannelId id, int order) {
-    CP::TEvent* ev = CP::TEventFolder::GetCurrentEvent();
-    if (!ev) {
-        CaptError("No event is loaded so context cannot be set.");
-        throw EChannelCalibUnknownType();
-    }
-    CP::TEventContext context = ev->GetContext();
-
-    if (id.IsMCChannel()) {
-        TMCChannelId mc(id);
-        int index = -1;
-        if (mc.GetType() == 0) index = mc.GetSequence();
-        else if (mc.GetType() == 1) index = 3;
-        else {
-            CaptWarn("Unknown channel: " << id);
-            throw CP::EChannelCalibUnknownType();
-        }
-            
-        // Get the peaking time.
-        CP::THandle<CP::TRealDatum> shapeVect
-            = ev->Get<CP::TRealDatum>("~/truth/elecSimple/shape");
-        double peakingTime = (*shapeVect)[index];
-        return peakingTime;
-    }
-
-    CP::TResultSetHandle<CP::TTPC_Channel_Calib_Table> table(context);
-    const CP::TTPC_Channel_Calib_Table* row = table.GetRowByIndex(id.AsUInt());
-
-    if (!row) {
-        CaptWarn("Unknown channel: " << id);
-        return 1.0*unit::microsecond;
-    }
-
-    return row->GetASICPeakTime()*unit::ns;
+    return GetKnownSnapshot(
+        id, CP::TChannelCalibSnapshot::kShape).GetPulseShapePeakTime(id);
 }
 
 double CP::TChannelCalib::GetAveragePulseShapeRise(CP::TChannelId id,
                                                    int order) {
-    CP::TEvent* ev = CP::TEventFolder::GetCurrentEvent();
-    if (!ev) {
-        CaptError("No event is loaded so context cannot be set.");
-        throw EChannelCalibUnknownType();
-    }
-    CP::TEventContext context = ev->GetContext();
-    
-    if (id.IsMCChannel()) return GetPulseShapeRise(id,order);
-
-    CP::TResultSetHandle<CP::TTPC_Channel_Calib_Table> table(context);
-    
-    Int_t numChannels(table.GetNumRows());
-
-    double riseShape = 0.0;
-    double count = 0.0;
-    for (int i = 0; i<numChannels; ++i) {
-        const CP::TTPC_Channel_Calib_Table* row = table.GetRow(i);
-        riseShape += row->GetASICRiseShape()*unit::ns;
-        count += 1.0;
-    }
-
-    riseShape /= count;
-
-    return riseShape;
+    return GetKnownSnapshot(
+        id, CP::TChannelCalibSnapshot::kShapeRise).GetAveragePulseShapeRise(id);
 }
 
 double CP::TChannelCalib::GetPulseShapeRise(CP::TChannelId id, int order) {
-    CP::TEvent* ev = CP::TEventFolder::GetCurrentEvent();
-    if (!ev) {
-        CaptError("No event is loaded so context cannot be set.");
-        throw EChannelCalibUnknownType();
-    }
-    CP::TEventContext context = ev->GetContext();
-
-    if (id.IsMCChannel()) {
-        TMCChannelId mc(id);
-        int index = -1;
-        if (mc.GetType() == 0) index = mc.GetSequence();
-        else if (mc.GetType() == 1) index = 3;
-        else {
-            CaptWarn("Unknown channel: " << id);
-            throw CP::EChannelCalibUnknownType();
-        }
-            
-        // Get the rising edge shape.
-        CP::THandle<CP::TRealDatum> riseVect
-            = ev->Get<CP::TRealDatum>("~/truth/elecSimple/shapeRise");
-        double riseShape = (*riseVect)[index];
-        return riseShape;
-    }
-
-    CP::TResultSetHandle<CP::TTPC_Channel_Calib_Table> table(context);
-    const CP::TTPC_Channel_Calib_Table* row = table.GetRowByIndex(id.AsUInt());
-
-    if (!row) {
-        CaptWarn("Unknown channel: " << id);
-        return 1.5;
-    }
-
-    return row->GetASICRiseShape();
+    return GetKnownSnapshot(
+        id, CP::TChannelCalibSnapshot::kShapeRise).GetPulseShapeRise(id);
 }
 
 double CP::TChannelCalib::GetAveragePulseShapeFall(CP::TChannelId id,
                                                    int order) {
-    CP::TEvent* ev = CP::TEventFolder::GetCurrentEvent();
-    if (!ev) {
-        CaptError("No event is loaded so context cannot be set.");
-        throw EChannelCalibUnknownType();
-    }
-    CP::TEventContext context = ev->GetContext();
-    
-    if (id.IsMCChannel()) return GetPulseShapeFall(id,order);
-
-    CP::TResultSetHandle<CP::TTPC_Channel_Calib_Table> table(context);
-    
-    Int_t numChannels(table.GetNumRows());
-
-    double fallShape = 0.0;
-    double count = 0.0;
-    for (int i = 0; i<numChannels; ++i) {
-        const CP::TTPC_Channel_Calib_Table* row = table.GetRow(i);
-        fallShape += row->GetASICFallShape()*unit::ns;
-        count += 1.0;
-    }
-
-    fallShape /= count;
-
-    return fallShape;
+    return GetKnownSnapshot(
+        id, CP::TChannelCalibSnapshot::kShapeFall).GetAveragePulseShapeFall(id);
 }
 
 double CP::TChannelCalib::GetPulseShapeFall(CP::TChannelId id, int order) {
-    CP::TEvent* ev = CP::TEventFolder::GetCurrentEvent();
-    if (!ev) {
-        CaptError("No event is loaded so context cannot be set.");
-        throw EChannelCalibUnknownType();
-    }
-    CP::TEventContext context = ev->GetContext();
-
-    if (id.IsMCChannel()) {
-        TMCChannelId mc(id);
-        int index = -1;
-        if (mc.GetType() == 0) index = mc.GetSequence();
-        else if (mc.GetType() == 1) index = 3;
-        else {
-            CaptWarn("Unknown channel: " << id);
-            throw CP::EChannelCalibUnknownType();
-        }
-            
-        // Get the falling edge shape.
-        CP::THandle<CP::TRealDatum> fallVect
-            = ev->Get<CP::TRealDatum>("~/truth/elecSimple/shapeFall");
-        double fallShape = (*fallVect)[index];
-        return fallShape;
-    }
-
-    CP::TResultSetHandle<CP::TTPC_Channel_Calib_Table> table(context);
-    const CP::TTPC_Channel_Calib_Table* row = table.GetRowByIndex(id.AsUInt());
-
-    if (!row) {
-        CaptWarn("Unknown channel: " << id);
-        return 1.7;
-    }
-
-    return row->GetASICFallShape();
+    return GetKnownSnapshot(
+        id, CP::TChannelCalibSnapshot::kShapeFall).GetPulseShapeFall(id);
 }
 
-
 double CP::TChannelCalib::GetPulseShape(CP::TChannelId id, double t) {
     if (t < 0.0) return 0.0;
 
@@ -538,165 +769,225 @@ double CP::TChannelCalib::GetAveragePulseShape(CP::TChannelId id, double t) {
     return 2.71828*v;
 }
 
-double CP::TChannelCalib::GetTimeConstant(CP::TChannelId id, int order) {
-    if (id.IsMCChannel()) {
-        TMCChannelId mc(id);
+void CP::TChannelCalib::GetPulseShape(CP::TChannelId id,
+                                      double t0, double dt, int n,
+                                      double* values) {
+    if (n < 1) return;
+    FillPulseShape(GetPulseShapePeakTime(id),
+                   GetPulseShapeRise(id),
+                   GetPulseShapeFall(id),
+                   t0, dt, n, values);
+}
 
-        int index = -1;
-        if (mc.GetType() == 0) index = mc.GetSequence();
-        else if (mc.GetType() == 1) index = 3;
-        else {
-            CaptWarn("Unknown channel: " << id);
-            throw CP::EChannelCalibUnknownType();
-        }
-            
-        CP::TEvent* ev = CP::TEventFolder::GetCurrentEvent();
-        
-        // Get the digitization step.
-        CP::THandle<CP::TRealDatum> stepVect
-            = ev->Get<CP::TRealDatum>("~/truth/elecSimple/digitStep");
-        double digitStep = (*stepVect)[index];
-
-        // Get the trigger offset.
-        CP::THandle<CP::TRealDatum> offsetVect
-            = ev->Get<CP::TRealDatum>("~/truth/elecSimple/triggerOffset");
-        double triggerOffset = (*offsetVect)[index];
-
-        if (order == 0) {
-            // The offset for the digitization time for each type of MC channel.
-            // This was determined "empirically", and depends on the details of
-            // the simulation.  It should be in the parameter file.  The exact
-            // value depends on the details of the time clustering.
-            double timeOffset = -triggerOffset;
-            if (index == 1) timeOffset += -digitStep + 23*unit::ns;
-            else if (index == 2) timeOffset += -digitStep + 52*unit::ns;
-            return timeOffset;
-        }
-        else if (order == 1) {
-            return digitStep;
-        }
+void CP::TChannelCalib::GetPulseShape(CP::TChannelId id,
+                                      const double* times, int n,
+                                      double* values) {
+    if (n < 1) return;
+    FillPulseShape(GetPulseShapePeakTime(id),
+                   GetPulseShapeRise(id),
+                   GetPulseShapeFall(id),
+                   times, n, values);
+}
 
-        return 0.0;
-    }
+void CP::TChannelCalib::GetAveragePulseShape(CP::TChannelId id,
+                                             double t0, double dt, int n,
+                                             double* values) {
+    if (n < 1) return;
+    FillPulseShape(GetAveragePulseShapePeakTime(id),
+                   GetAveragePulseShapeRise(id),
+                   GetAveragePulseShapeFall(id),
+                   t0, dt, n, values);
+}
 
-    /// The time offset frore the TPC trigger is fixed to 3200 samples in
-    /// software.  This isn't going to change, so just provide the fixed
-    /// value.  The sample rate of 500 ns/sample is fixed in hardware against
-    /// a very good clock, so it is also fixed.
-    if (order == 0) return -1.600*unit::ms;
-    if (order == 1) return 500.0*unit::ns;
-    return 0.0;
+void CP::TChannelCalib::GetAveragePulseShape(CP::TChannelId id,
+                                             const double* times, int n,
+                                             double* values) {
+    if (n < 1) return;
+    FillPulseShape(GetAveragePulseShapePeakTime(id),
+                   GetAveragePulseShapeRise(id),
+                   GetAveragePulseShapeFall(id),
+                   times, n, values);
 }
 
-double CP::TChannelCalib::GetDigitizerConstant(CP::TChannelId id, int order) {
+double CP::TChannelCalib::GetPulseShape(CP::TChannelId id, double t,
+                                        double& dFdT, double* dFdParams) {
+    return PulseShapeGradientKernel(t,
+                                    GetPulseShapePeakTime(id),
+                                    GetPulseShapeRise(id),
+                                    GetPulseShapeFall(id),
+                                    dFdT, dFdParams, 1);
+}
+
+void CP::TChannelCalib::GetPulseShape(CP::TChannelId id,
+                                      const double* times, int n,
+                                      double* values, double* dFdT,
+                                      double* dFdParams) {
+    if (n < 1) return;
+    double peakingTime = GetPulseShapePeakTime(id);
+    double riseShape = GetPulseShapeRise(id);
+    double fallShape = GetPulseShapeFall(id);
+    for (int i = 0; i<n; ++i) {
+        values[i] = PulseShapeGradientKernel(times[i],
+                                             peakingTime,
+                                             riseShape,
+                                             fallShape,
+                                             dFdT[i],
+                                             dFdParams? dFdParams+i: NULL,
+                                             n);
+    }
+}
+
+int CP::TChannelCalib::GetPulseShapeTemplateId(CP::TChannelId id) {
     if (id.IsMCChannel()) {
-        TMCChannelId mc(id);
+        return gPulseShapeTemplates.Find(GetPulseShapePeakTime(id),
+                                         GetPulseShapeRise(id),
+                                         GetPulseShapeFall(id),
+                                         GetTimeConstant(id,1));
+    }
+    const TemplateIds& ids = UpdateTemplateIds();
+    return ids.fTemplateId[ids.fCalib->GetSlot(id)];
+}
 
-        int index = -1;
-        if (mc.GetType() == 0) index = mc.GetSequence();
-        else if (mc.GetType() == 1) index = 3;
-        else {
-            CaptWarn("Unknown channel: " << id);
-            throw CP::EChannelCalibUnknownType();
-        }
-            
-        CP::TEvent* ev = CP::TEventFolder::GetCurrentEvent();
-        
-        if (order == 0) {
-            // Get the pedestal
-            CP::THandle<CP::TRealDatum> pedVect
-                = ev->Get<CP::TRealDatum>("~/truth/elecSimple/pedestal");
-            return (*pedVect)[index];
-        }
-        else if (order == 1) {
-            // Get the digitizer slope
-            CP::THandle<CP::TRealDatum> slopeVect
-                = ev->Get<CP::TRealDatum>("~/truth/elecSimple/slope");
-            return (*slopeVect)[index];
-        }
+const std::vector<double>&
+CP::TChannelCalib::GetPulseShapeTemplate(CP::TChannelId id) {
+    int templateId = GetPulseShapeTemplateId(id);
+    return gPulseShapeTemplates.fTemplates[templateId];
+}
+
+int CP::TChannelCalib::GetPulseShapeTemplateCount() {
+    return gPulseShapeTemplates.fTemplates.size();
+}
+
+double CP::TChannelCalib::GetPulseShapeTemplateDedupRatio() {
+    // Only count the templates that are used by channels found in the
+    // table, so MC templates and the defaults don't change the ratio.
+    const TemplateIds& ids = UpdateTemplateIds();
+    const CP::TChannelCalibSnapshot::CalibTable& calib = *ids.fCalib;
+    std::set<int> used;
+    for (std::size_t slot = 0; slot<calib.fFound.size(); ++slot) {
+        if (calib.fFound[slot]) used.insert(ids.fTemplateId[slot]);
+    }
+    if (used.empty()) return 0.0;
+    return 1.0*calib.fChannels/used.size();
+}
+
+std::size_t CP::TChannelCalib::GetPulseShapeTemplateMemoryUsage() {
+    return gPulseShapeTemplates.GetMemoryUsage()
+        + gTemplateIds.fTemplateId.capacity()*sizeof(int);
+}
 
-        return 0.0;
+const std::vector<double>&
+CP::TChannelCalib::GetResponseKernel(CP::TChannelId id, int samples) {
+    if (samples < 1) samples = 1;
+    int templateId = GetPulseShapeTemplateId(id);
+    return gPulseShapeTemplates.FindKernel(templateId, samples).fTime;
+}
+
+const std::vector< std::complex<double> >&
+CP::TChannelCalib::GetResponseSpectrum(CP::TChannelId id, int samples) {
+    if (samples < 1) samples = 1;
+    int templateId = GetPulseShapeTemplateId(id);
+    return gPulseShapeTemplates.FindSpectrum(templateId, samples).fSpectrum;
+}
+
+void CP::TChannelCalib::GetWaveformCharge(CP::TChannelId id,
+                                          const short* adc, int n,
+                                          double* charge, double* times) {
+    GetWaveformCharge(&id, 1, adc, n, charge, times);
+}
+
+void CP::TChannelCalib::GetWaveformCharge(const CP::TChannelId* ids,
+                                          int channels,
+                                          const short* adc, int n,
+                                          double* charge, double* times) {
+    if (n < 1) return;
+    // The snapshot is found once, and each channel gets all of its
+    // constants from one calibration record.  The sample time constants
+    // are only needed for an MC channel when the times are filled.
+    unsigned int datums
+        = (1u << CP::TChannelCalibSnapshot::kGain)
+        | (1u << CP::TChannelCalibSnapshot::kPedestal)
+        | (1u << CP::TChannelCalibSnapshot::kSlope);
+    if (times) {
+        datums |= (1u << CP::TChannelCalibSnapshot::kDigitStep)
+            | (1u << CP::TChannelCalibSnapshot::kTriggerOffset);
+    }
+    const CP::TChannelCalibSnapshot& snapshot = GetCurrentSnapshot();
+    unsigned int checked = 0;
+    CalibRecord record;
+    for (int c = 0; c<channels; ++c) {
+        CheckKnownChannel(snapshot, ids[c]);
+        CheckMCConstants(snapshot, ids[c], checked, datums);
+        snapshot.GetCalibRecord(ids[c], record);
+        double gain = record.fDigitizerSlope*record.fGain;
+        double scale = 0.0;
+        if (gain != 0.0) scale = 1.0/gain;
+        else CaptError("Zero gain for channel: " << ids[c]);
+        std::size_t offset = (std::size_t) c*n;
+        FillCharge(adc + offset, n, record.fPedestal, scale,
+                   record.fTimeOffset, record.fTimeStep, charge + offset,
+                   times? times + offset: NULL);
     }
+}
 
-    // This is fixed for the data since we use an injected pulse with a known
-    // charge to calibrate the ASIC and the digitizer as a combined system.
-    // The precise value doesn't matter, so we are using the design spec.  The
-    // actual digitizers vary by about 20%.
-    if (order == 1) return 2.5/unit::mV;
-    else if (order == 0) {
-        CP::TEvent* ev = CP::TEventFolder::GetCurrentEvent();
-        if (!ev) {
-            CaptError("No event is loaded so context cannot be set.");
-            throw EChannelCalibUnknownType();
-        }
-        CP::TEventContext context = ev->GetContext();
+double CP::TChannelCalib::GetTimeConstant(CP::TChannelId id, int order) {
+    const CP::TChannelCalibSnapshot& snapshot = GetKnownSnapshot(id);
+    if (order == 0 || order == 1) {
+        CheckMCConstant(snapshot, CP::TChannelCalibSnapshot::kDigitStep, id);
+    }
+    if (order == 0) {
+        CheckMCConstant(snapshot,
+                        CP::TChannelCalibSnapshot::kTriggerOffset, id);
+    }
+    return snapshot.GetTimeConstant(id,order);
+}
 
-        CP::TResultSetHandle<CP::TTPC_Channel_Calib_Table> table(context);
-        const CP::TTPC_Channel_Calib_Table* row
-            = table.GetRowByIndex(id.AsUInt());
-        
-        if (!row) {
-            CaptWarn("Unknown channel: " << id);
-            return 2048;
-        }
-        
-        return row->GetDigitizerPedestal();
+double CP::TChannelCalib::GetDigitizerConstant(CP::TChannelId id, int order) {
+    const CP::TChannelCalibSnapshot& snapshot = GetKnownSnapshot(id);
+    if (order == 0) {
+        CheckMCConstant(snapshot, CP::TChannelCalibSnapshot::kPedestal, id);
+    }
+    else if (order == 1) {
+        CheckMCConstant(snapshot, CP::TChannelCalibSnapshot::kSlope, id);
     }
-    return 0.0;
+    return snapshot.GetDigitizerConstant(id,order);
 }
 
 double CP::TChannelCalib::GetElectronLifetime() {
-    CP::TEvent* ev = CP::TEventFolder::GetCurrentEvent();
-    
-    // Get the electron lifetime.
-    CP::THandle<CP::TRealDatum> stepVect
-        = ev->Get<CP::TRealDatum>("~/truth/elecSimple/argon");
-    if (!stepVect) return 3.14E+8*unit::second;
-    return (*stepVect)[1];
+    return GetCurrentSnapshot().GetElectronLifetime();
 }
 
 double CP::TChannelCalib::GetElectronDriftVelocity() {
-    CP::TEvent* ev = CP::TEventFolder::GetCurrentEvent();
-    
-    // Get the electron lifetime.
-    CP::THandle<CP::TRealDatum> stepVect
-        = ev->Get<CP::TRealDatum>("~/truth/elecSimple/argon");
-    if (!stepVect) return 1.6*unit::millimeter/unit::microsecond;
-    return (*stepVect)[0];
+    return GetCurrentSnapshot().GetElectronDriftVelocity();
 }
 
 double CP::TChannelCalib::GetCollectionEfficiency(CP::TChannelId id) {
     if (id.IsMCChannel()) {
         TMCChannelId mc(id);
-
-        int index = -1;
-        if (mc.GetType() == 0) index = mc.GetSequence();
-        else if (mc.GetType() == 1) return 1.0;
-        else {
+        if (mc.GetType() != 0 && mc.GetType() != 1) {
             CaptWarn("Unknown channel: " << id);
             throw CP::EChannelCalibUnknownType();
         }
-            
-        if (index == 0) {
-            // A X channel.
-            double eff = CP::TRuntimeParameters::Get().GetParameterD(
-                "clusterCalib.mc.wire.collection.x");
-            return eff;
-        }
-        else if (index == 1) {
-            // A V channel.
-            double eff = CP::TRuntimeParameters::Get().GetParameterD(
-                "clusterCalib.mc.wire.collection.v");
-            return eff;
-        }
-        else if (index == 2) {
-            // A U channel.
-            double eff = CP::TRuntimeParameters::Get().GetParameterD(
-                "clusterCalib.mc.wire.collection.u");
-            return eff;
-        }
     }
+    if (!CP::TEventFolder::GetCurrentEvent()) {
+        // The efficiencies don't depend on the context, so use a snapshot
+        // without any tables.
+        static const CP::TChannelCalibSnapshot noEvent(
+            (CP::TEventContext()));
+        return noEvent.GetCollectionEfficiency(id);
+    }
+    return GetCurrentSnapshot().GetCollectionEfficiency(id);
+}
 
-    return 1.0;
+void CP::TChannelCalib::CorrectCharge(int plane, const double* driftTimes,
+                                      int n, double* charges) {
+    if (n < 1) return;
+    GetCurrentSnapshot().CorrectCharge(plane, driftTimes, n, charges);
 }
 
+void CP::TChannelCalib::CorrectCharge(const int* planes,
+                                      const double* driftTimes,
+                                      int n, double* charges) {
+    if (n < 1) return;
+    GetCurrentSnapshot().CorrectCharge(planes, driftTimes, n, charges);
+}
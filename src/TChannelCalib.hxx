@@ -3,6 +3,13 @@
 
 #include <ECore.hxx>
 
+#include "TChannelCalibSnapshot.hxx"
+#include "TChannelIndex.hxx"
+#include "TChannelMask.hxx"
+
+#include <vector>
+#include <complex>
+
 namespace CP {
     class TChannelCalib;
     class TChannelId;
@@ -16,12 +23,29 @@ namespace CP {
 
 /// Provide generic an interface to get the calibration coefficients.  This
 /// works for calibration constants provided in an MC file, and for constants
-/// for the data.
+/// for the data.  The TPC calibration table is loaded once for each
+/// validity range, so the per-channel constants for the data are found
+/// without a database access.
+///
+/// The constants are provided for the current event (see
+/// CP::TEventFolder::GetCurrentEvent()) using the CP::TChannelCalibSnapshot
+/// for that event.  Code that knows the event (or context) it is
+/// calibrating should use a CP::TChannelCalibSnapshot directly.
+///
+/// This class is not thread safe.  The snapshot for the current event and
+/// the pulse shape template caches are shared by every TChannelCalib
+/// object without a lock, so it must only be used from one thread.  Code
+/// that calibrates events in several threads should create a
+/// CP::TChannelCalibSnapshot for each event in the thread that uses it.
 class CP::TChannelCalib {
 public:
     TChannelCalib();
     ~TChannelCalib();
 
+    /// Get the calibration snapshot for the current event.  The reference is
+    /// valid until the current event changes.
+    const CP::TChannelCalibSnapshot& GetSnapshot();
+
     /// This is true if the channel is considered good.  This gives the status
     /// of an electronics channel based on calibrations (usually done using an
     /// injected pulse).  An electronics channel can be working independent of
@@ -31,13 +55,29 @@ public:
     /// This is true if the wire is working in the detector.  This gives the
     /// status of whether a wire is correctly connected to a channel.  A
     /// channel can be good, but the wire still won't read charge.  For
-    /// example, the capacitor might be bad.
+    /// example, the capacitor might be bad.  The wires listed in
+    /// CP::TIgnoredWireList for the run of the current event are not good.
     bool IsGoodWire(CP::TGeometryId id); 
 
     /// Determine if the wire attached to this channel is good.  Note channels
     /// not attached to an actual wire automatically return false.
     bool IsGoodWire(CP::TChannelId id); 
 
+    /// This is true if the channel is good, and is attached to a good wire.
+    /// This is the same as IsGoodChannel(id) && IsGoodWire(id), but is
+    /// found with a single bit test in GetUsableChannels().
+    bool IsUsableChannel(CP::TChannelId id);
+
+    /// Get the mask of usable channels for the current event context.  This
+    /// combines the bad channel table, the status of the calibration fit and
+    /// the list of ignored wires, and covers all of the channels in the
+    /// detector.  The mask is built once for each context (it is rebuilt
+    /// when the status table, the channel map, or the ignored wires
+    /// change), so reconstruction
+    /// can skip dead channels without looking up each digit.  The reference
+    /// is valid until the context changes.
+    const CP::TChannelMask& GetUsableChannels();
+
     /// This returns true if the signal is a bipolar signal.  The collection
     /// wires and PMTs are unipolar.  The induction wires are bipolar.
     bool IsBipolarSignal(CP::TChannelId id);
@@ -46,6 +86,66 @@ public:
     /// information derived during calibration with the hand modified
     /// information in the TPC_BAD_CHANNEL_TABLE
     int GetChannelStatus(CP::TChannelId id);
+
+    /// The status of all of the channels in the detector.  See
+    /// CP::TChannelCalibSnapshot::StatusTable.
+    typedef CP::TChannelCalibSnapshot::StatusTable StatusTable;
+
+    /// Get the status of every channel for the current event context.  This
+    /// is the status of the MC channels for an MC context, and of the TPC
+    /// channels otherwise.  The index covers the whole detector (the MC
+    /// wires, or the channels in the channel map) as well as the channels in
+    /// the bad channel table.  The table is loaded once for each validity
+    /// range of the bad channel and calibration tables (and channel map), so
+    /// an unpacker can mask the bad channels in a single pass over fStatus.
+    /// The reference is valid until the context changes.
+    const StatusTable& GetDetectorStatus();
+
+    /// \name Calibration records
+    /// All of the constants and the status of a channel in one struct, so a
+    /// calibration pass can find everything for a channel with one call,
+    /// and hoist the calibration out of its inner loop.  See
+    /// CP::TChannelCalibSnapshot::Record.  These throw an exception for an
+    /// unknown MC channel, or if an MC constant is missing from the event.
+    /// @{
+    typedef CP::TChannelCalibSnapshot::Record CalibRecord;
+
+    /// Fill the calibration record for a channel.
+    void GetCalibRecord(CP::TChannelId id, CalibRecord& record);
+
+    /// Fill the calibration records for a contiguous array of "n"
+    /// channels.
+    void GetCalibRecord(const CP::TChannelId* ids, int n,
+                        CalibRecord* records);
+
+    /// Get the calibration records for every channel in the detector.  The
+    /// records are in the same order as the slots of the index for
+    /// GetUsableChannels(), so the record for a channel is at
+    /// GetUsableChannels().GetIndex().GetSlot(id).  The records are filled
+    /// once for each context, and the reference is valid until the context
+    /// changes.
+    const std::vector<CalibRecord>& GetDetectorCalibRecords();
+
+    /// Fill the calibration record for a channel, and substitute an ASIC,
+    /// motherboard or detector average for the gain and pulse shape when
+    /// the calibration fit failed (kBadFit or kBadPeak).  See
+    /// CP::TChannelCalibSnapshot::Fallback.
+    void GetCalibRecord(CP::TChannelId id, CalibRecord& record,
+                        CP::TChannelCalibSnapshot::Fallback fallback);
+    /// @}
+
+    /// \name Grouped averages
+    /// The average gain and pulse shape of the well calibrated channels on
+    /// the same cold ASIC or cold motherboard as a channel.  The averages
+    /// are found once for each calibration table, so these are O(1)
+    /// lookups.  See CP::TChannelCalibSnapshot::GetASICAverage().  These
+    /// throw an exception for an unknown MC channel, or if the MC gain or
+    /// pulse shape is missing from the event.
+    /// @{
+    typedef CP::TChannelCalibSnapshot::Average CalibAverage;
+    CalibAverage GetASICAverage(CP::TChannelId id);
+    CalibAverage GetMotherboardAverage(CP::TChannelId id);
+    /// @}
     
     /// Get the amplifier gain constants for a channel.  The second parameter
     /// is the order of the constant.  Normally, order 0 is the offset for the
@@ -70,6 +170,25 @@ public:
     /// (ADC/volt), order 2 is quadratic, etc.
     double GetDigitizerConstant(CP::TChannelId id, int order=1);
 
+    /// \name Waveform charge calibration
+    /// Convert "n" ADC samples for a channel into charge.  The pedestal and
+    /// the digitizer slope (GetDigitizerConstant()), and the gain
+    /// (GetGainConstant()) are looked up once for the channel, and the
+    /// charge for each sample is (adc - pedestal)/(slope*gain).  If "times"
+    /// is not NULL, it is filled with the time of each sample using the
+    /// time offset and step from GetTimeConstant().  The multi-channel form
+    /// takes "channels" waveforms of "n" samples stored one after the other
+    /// in "adc", and fills "charge" (and "times") with the same layout.  It
+    /// finds the snapshot for the event once, and gets the constants for
+    /// each channel with one GetCalibRecord() call.
+    /// @{
+    void GetWaveformCharge(CP::TChannelId id, const short* adc, int n,
+                           double* charge, double* times = NULL);
+    void GetWaveformCharge(const CP::TChannelId* ids, int channels,
+                           const short* adc, int n,
+                           double* charge, double* times = NULL);
+    /// @}
+
     /// Get the electron lifetime.
     double GetElectronLifetime();
 
@@ -86,12 +205,99 @@ public:
     /// differences, but those are not calculated with CLUSTERCALIB.exe.
     double GetCollectionEfficiency(CP::TChannelId id);
 
+    /// Correct an array of hit charges for the attenuation during the drift
+    /// and the collection efficiency.  The lifetime, drift velocity and
+    /// collection efficiencies are resolved once for each event.  See
+    /// CP::TChannelCalibSnapshot::CorrectCharge().
+    /// @{
+    void CorrectCharge(int plane, const double* driftTimes, int n,
+                       double* charges);
+    void CorrectCharge(const int* planes, const double* driftTimes, int n,
+                       double* charges);
+    /// @}
+
     /// Get the pulse shaping for the ASIC as a function of time.
     double GetAveragePulseShape(CP::TChannelId id, double t);
 
     /// Get the average pulse shaping for the ASIC as a function of time.
     double GetPulseShape(CP::TChannelId id, double t);
 
+    /// \name Whole waveform pulse shapes
+    /// Fill "values" with the pulse shaping at "n" times.  The times are
+    /// either uniformly spaced starting at "t0" with a step of "dt", or are
+    /// given in the "times" array.  The calibration constants are only
+    /// looked up once, and the loop over the times is written so that it
+    /// can be vectorized when a vector math library is available, so these
+    /// should be used when a response is needed for a whole waveform.  The
+    /// values agree with the single time methods to better than 1E-12 (the
+    /// peak of the shaping is one).
+    /// @{
+    void GetPulseShape(CP::TChannelId id, double t0, double dt, int n,
+                       double* values);
+    void GetPulseShape(CP::TChannelId id, const double* times, int n,
+                       double* values);
+    void GetAveragePulseShape(CP::TChannelId id, double t0, double dt, int n,
+                              double* values);
+    void GetAveragePulseShape(CP::TChannelId id, const double* times, int n,
+                              double* values);
+    /// @}
+
+    /// \name Pulse shape gradients
+    /// Get the pulse shaping and its analytic derivatives in one pass.  This
+    /// is intended for hit fitters so that the shape doesn't need to be
+    /// differentiated numerically.  The derivative with respect to time is
+    /// returned in "dFdT".  If "dFdParams" is not NULL, it is filled with
+    /// the derivatives with respect to the peaking time, the rise shape and
+    /// the fall shape.  The derivative with respect to the amplitude of a
+    /// pulse is the shape itself.  The batch form fills "n" values, and
+    /// "dFdParams" holds 3*n values with all of the peaking time derivatives
+    /// first, then the rise shape derivatives, and then the fall shape
+    /// derivatives.
+    /// @{
+    double GetPulseShape(CP::TChannelId id, double t, double& dFdT,
+                         double* dFdParams = NULL);
+    void GetPulseShape(CP::TChannelId id, const double* times, int n,
+                       double* values, double* dFdT,
+                       double* dFdParams = NULL);
+    /// @}
+
+    /// \name Pulse shape templates
+    /// Get the pulse shaping for a channel sampled at the digitizer period
+    /// (see GetTimeConstant()), starting at zero time and ending when the
+    /// shaping vanishes.  Channels with the same shaping parameters share a
+    /// template after the peaking time and shape factors are quantized
+    /// (the steps are set by the captChanInfo.template.peakTime and
+    /// captChanInfo.template.shape parameters), so the template for a
+    /// channel is usually found with an array lookup.  The templates are
+    /// rebuilt when the calibration table changes, and references to them
+    /// are only valid until then.  Channels that are not in the table share
+    /// the template for the default parameters.  The dedup ratio is the
+    /// number of channels in the calibration table divided by the number of
+    /// templates used by those channels.
+    /// @{
+    int GetPulseShapeTemplateId(CP::TChannelId id);
+    const std::vector<double>& GetPulseShapeTemplate(CP::TChannelId id);
+    int GetPulseShapeTemplateCount();
+    double GetPulseShapeTemplateDedupRatio();
+    std::size_t GetPulseShapeTemplateMemoryUsage();
+    /// @}
+
+    /// \name Response kernels
+    /// Get the response of a channel for a waveform with "samples" samples
+    /// at the digitizer period (see GetTimeConstant()).  The time domain
+    /// kernel is the pulse shape template padded with zeros (or truncated)
+    /// to the waveform length, and the spectrum is the real FFT of the
+    /// kernel (samples/2+1 values, not normalized; see CP::TRealFFT).  The
+    /// kernels are built the first time they are requested, are shared by
+    /// channels with the same template, and are kept until the calibration
+    /// table changes.  The references are only valid until then.
+    /// @{
+    const std::vector<double>& GetResponseKernel(CP::TChannelId id,
+                                                 int samples);
+    const std::vector< std::complex<double> >& GetResponseSpectrum(
+        CP::TChannelId id, int samples);
+    /// @}
+
     /// Get the average peaking time for the all of the ASIC.  This shouldn't
     /// be used directly.  Access the pulse shape through
     /// GetAveragePulseShape().
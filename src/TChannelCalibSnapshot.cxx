@@ -0,0 +1,769 @@
+#include "TChannelCalibSnapshot.hxx"
+
+#include <TEvent.hxx>
+#include <THandle.hxx>
+#include <TRealDatum.hxx>
+#include <TCaptLog.hxx>
+#include <TChannelId.hxx>
+#include <TMCChannelId.hxx>
+#include <HEPUnits.hxx>
+#include <CaptGeomId.hxx>
+#include <TChannelInfo.hxx>
+#include <TGeometryInfo.hxx>
+#include <TRuntimeParameters.hxx>
+
+#include "TIgnoredWireList.hxx"
+
+#include <TTPC_Bad_Channel_Table.hxx>
+#include <TTPC_Channel_Calib_Table.hxx>
+
+#include <TResultSetHandle.hxx>
+#include <DatabaseUtils.hxx>
+#include <TDbi.hxx>
+
+#include <cmath>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <map>
+#include <algorithm>
+
+#define GET_CALIBRATION_STATUS
+
+namespace {
+    typedef CP::TChannelCalibSnapshot::CalibTable CalibTable;
+    typedef CP::TChannelCalibSnapshot::StatusTable StatusTable;
+    typedef CP::TChannelCalibSnapshot::Average Average;
+    typedef CP::TChannelCalibSnapshot::AverageTable AverageTable;
+
+    // The status bits for a channel that doesn't have a good calibration
+    // fit.
+    const int kBadCalibration = CP::TTPC_Channel_Calib_Table::kNoSignal
+        | CP::TTPC_Channel_Calib_Table::kBadPeak
+        | CP::TTPC_Channel_Calib_Table::kBadFit;
+
+    // Serialize access to the table caches.  This is held while a table is
+    // loaded, so only one thread accesses the database.
+    std::mutex gTableMutex;
+
+    // Fill every slot of a calibration table with the defaults.  A nearly
+    // empty table means that the channels haven't been calibrated, so they
+    // are all good.  Otherwise, channels missing from the table have no
+    // signal.
+    void FillCalibDefaults(CalibTable& calib) {
+        int slots = calib.fIndex.GetSize() + 1;
+        int status = CP::TTPC_Channel_Calib_Table::kNoSignal;
+        if (calib.fRows < 10) status = 0;
+        calib.fFound.assign(slots, 0);
+        calib.fStatus.assign(slots, status);
+        calib.fGain.assign(slots, 14.0*unit::mV/unit::fC);
+        calib.fPeakTime.assign(slots, 1.0*unit::microsecond);
+        calib.fRise.assign(slots, 1.5);
+        calib.fFall.assign(slots, 1.7);
+        calib.fPedestal.assign(slots, 2048);
+        calib.fAveragePeakTime = calib.fPeakTime.back();
+        calib.fAverageRise = calib.fRise.back();
+        calib.fAverageFall = calib.fFall.back();
+    }
+
+    // Make the calibration table with the default values for every
+    // channel.
+    std::shared_ptr<const CalibTable> MakeDefaultCalibTable() {
+        std::shared_ptr<CalibTable> calib(new CalibTable);
+        FillCalibDefaults(*calib);
+        return calib;
+    }
+
+    // The calibration table with the default values for every channel.  This
+    // is used for the MC contexts.
+    std::shared_ptr<const CalibTable> DefaultCalibTable() {
+        static const std::shared_ptr<const CalibTable> defaultCalib
+            = MakeDefaultCalibTable();
+        return defaultCalib;
+    }
+
+    // Add the constants in a slot of the calibration table to an average.
+    void AddToAverage(Average& average, const CalibTable& calib, int slot) {
+        average.fGain += calib.fGain[slot];
+        average.fPeakTime += calib.fPeakTime[slot];
+        average.fRise += calib.fRise[slot];
+        average.fFall += calib.fFall[slot];
+        ++average.fChannels;
+    }
+
+    // Turn the sums into an average.
+    void FinishAverage(Average& average) {
+        if (average.fChannels < 1) return;
+        average.fGain /= average.fChannels;
+        average.fPeakTime /= average.fChannels;
+        average.fRise /= average.fChannels;
+        average.fFall /= average.fChannels;
+    }
+
+    // Find the ASIC and motherboard of each channel in the calibration
+    // table, and average the constants of the well calibrated channels.
+    std::shared_ptr<const AverageTable>
+    MakeAverageTable(const CalibTable& calib,
+                     const CP::TChannelMap& channelMap) {
+        std::shared_ptr<AverageTable> averages(new AverageTable);
+        int slots = calib.fPeakTime.size();
+        averages->fASIC.assign(slots, -1);
+        averages->fMotherboard.assign(slots, -1);
+
+        // Assign a group to each ASIC and motherboard.
+        std::map<std::pair<int,int>, int> asics;
+        std::map<int, int> motherboards;
+        for (int slot = 0; slot < calib.fIndex.GetSize(); ++slot) {
+            CP::TChannelMap::Record record;
+            CP::TChannelId id = calib.fIndex.GetChannel(slot);
+            if (!channelMap.GetChannelRecord(id, record)) continue;
+            if (record.fMotherboard < 0) continue;
+            int group = motherboards.size();
+            group = motherboards.insert(
+                std::make_pair((int) record.fMotherboard, group)).first->second;
+            averages->fMotherboard[slot] = group;
+            if (record.fASIC < 0) continue;
+            group = asics.size();
+            group = asics.insert(
+                std::make_pair(std::make_pair((int) record.fMotherboard,
+                                              (int) record.fASIC),
+                               group)).first->second;
+            averages->fASIC[slot] = group;
+        }
+        averages->fASICAverage.resize(asics.size());
+        averages->fMotherboardAverage.resize(motherboards.size());
+
+        for (int slot = 0; slot < calib.fIndex.GetSize(); ++slot) {
+            if (calib.fStatus[slot] & kBadCalibration) continue;
+            AddToAverage(averages->fDetectorAverage, calib, slot);
+            int group = averages->fMotherboard[slot];
+            if (group < 0) continue;
+            AddToAverage(averages->fMotherboardAverage[group], calib, slot);
+            group = averages->fASIC[slot];
+            if (group < 0) continue;
+            AddToAverage(averages->fASICAverage[group], calib, slot);
+        }
+        for (std::size_t i = 0; i<averages->fASICAverage.size(); ++i) {
+            FinishAverage(averages->fASICAverage[i]);
+        }
+        for (std::size_t i = 0; i<averages->fMotherboardAverage.size(); ++i) {
+            FinishAverage(averages->fMotherboardAverage[i]);
+        }
+        FinishAverage(averages->fDetectorAverage);
+
+        // If there aren't any well calibrated channels, then use the
+        // defaults for the detector.
+        if (averages->fDetectorAverage.fChannels < 1) {
+            int defaultSlot = calib.fIndex.GetSize();
+            averages->fDetectorAverage.fGain = calib.fGain[defaultSlot];
+            averages->fDetectorAverage.fPeakTime = calib.fPeakTime[defaultSlot];
+            averages->fDetectorAverage.fRise = calib.fRise[defaultSlot];
+            averages->fDetectorAverage.fFall = calib.fFall[defaultSlot];
+        }
+
+        return averages;
+    }
+
+    // The averages for the default calibration table.
+    std::shared_ptr<const AverageTable> DefaultAverageTable() {
+        static const std::shared_ptr<const AverageTable> defaultAverages
+            = MakeAverageTable(*DefaultCalibTable(), CP::TChannelMap());
+        return defaultAverages;
+    }
+
+    // The status table where every channel is good.
+    std::shared_ptr<const StatusTable> EmptyStatusTable() {
+        static const std::shared_ptr<const StatusTable> empty(
+            new StatusTable);
+        return empty;
+    }
+
+    // Load the tpc pulse gain and shape calibration table.
+    std::shared_ptr<const CalibTable>
+    LoadCalibTable(const CP::TEventContext& context) {
+        std::shared_ptr<CalibTable> calib(new CalibTable);
+        calib->fValidity.Reset(context);
+
+        // Get the calibration table.
+        CP::TResultSetHandle<CP::TTPC_Channel_Calib_Table> table(context);
+        Int_t numChannels(table.GetNumRows());
+        calib->fValidity.Restrict(table.GetValidityRec());
+        calib->fRows = numChannels;
+
+        for (int i = 0; i<numChannels; ++i) {
+            const CP::TTPC_Channel_Calib_Table* row = table.GetRow(i);
+            if (!row) continue;
+            calib->fIndex.Include(row->GetChannelId());
+        }
+
+        FillCalibDefaults(*calib);
+
+        int found = 0;
+        double peakTime = 0.0;
+        double riseShape = 0.0;
+        double fallShape = 0.0;
+        double count = 0.0;
+        for (int i = 0; i<numChannels; ++i) {
+            const CP::TTPC_Channel_Calib_Table* row = table.GetRow(i);
+            if (!row) continue;
+            peakTime += row->GetASICPeakTime()*unit::ns;
+            riseShape += row->GetASICRiseShape()*unit::ns;
+            fallShape += row->GetASICFallShape()*unit::ns;
+            count += 1.0;
+            int slot = calib->fIndex.GetSlot(row->GetChannelId());
+            if (slot < 0) continue;
+            if (numChannels >= 10) {
+                calib->fStatus[slot] = row->GetChannelStatus();
+            }
+            calib->fGain[slot] = row->GetASICGain()*unit::mV/unit::fC;
+            calib->fPeakTime[slot] = row->GetASICPeakTime()*unit::ns;
+            calib->fRise[slot] = row->GetASICRiseShape();
+            calib->fFall[slot] = row->GetASICFallShape();
+            calib->fPedestal[slot] = row->GetDigitizerPedestal();
+            calib->fFound[slot] = 1;
+            ++found;
+        }
+
+        // Calculate the averages over the detector.  If the table is
+        // empty, then the defaults are kept.
+        if (count > 0.0) {
+            calib->fAveragePeakTime = peakTime/count;
+            calib->fAverageRise = riseShape/count;
+            calib->fAverageFall = fallShape/count;
+        }
+
+        calib->fChannels = found;
+
+        CaptLog("Channel calibration table update: " << context
+                << " (" << found << " channels)");
+
+        return calib;
+    }
+
+    // Load the status table for the TPC channels.  The status from the bad
+    // channel table overrides the status of the calibration fit.  The index
+    // covers every channel in the channel map, so the status of any channel
+    // in the detector is found without a fallback.
+    std::shared_ptr<const StatusTable>
+    LoadTPCStatusTable(const CP::TEventContext& context,
+                       const CalibTable& calib,
+                       const CP::TChannelMap& channelMap,
+                       CP::TValidityRange& validity) {
+        validity.Reset(context);
+
+        // Get the bad channel table.
+        CP::TResultSetHandle<CP::TTPC_Bad_Channel_Table> chanTable(context);
+        Int_t numChannels(chanTable.GetNumRows());
+        validity.Restrict(chanTable.GetValidityRec());
+
+        std::shared_ptr<StatusTable> table(new StatusTable);
+        for (int i = 0; i<numChannels; ++i) {
+            const CP::TTPC_Bad_Channel_Table* chanRow = chanTable.GetRow(i);
+            if (!chanRow) continue;
+            table->fIndex.Include(chanRow->GetChannelId());
+        }
+        for (int i = 0; i<channelMap.GetRecordCount(); ++i) {
+            table->fIndex.Include(channelMap.GetRecord(i).GetChannelId());
+        }
+#ifdef GET_CALIBRATION_STATUS
+        // Get the status of the calibration fit for the channels.  This
+        // should only be enabled after the calibration fitting routine has
+        // settled on a good set of statis bits.
+        for (int slot = 0; slot < calib.fIndex.GetSize(); ++slot) {
+            table->fIndex.Include(calib.fIndex.GetChannel(slot));
+        }
+#endif
+
+        // Start with the calibration status.  The last slot (which isn't a
+        // channel) gets the status of channels missing from the tables.
+        int slots = table->fIndex.GetSize() + 1;
+        table->fStatus.assign(slots, 0);
+#ifdef GET_CALIBRATION_STATUS
+        for (int slot = 0; slot < slots; ++slot) {
+            CP::TChannelId id = table->fIndex.GetChannel(slot);
+            table->fStatus[slot] = calib.fStatus[calib.GetSlot(id)];
+        }
+#endif
+
+        for (int i = 0; i<numChannels; ++i) {
+            const CP::TTPC_Bad_Channel_Table* chanRow = chanTable.GetRow(i);
+            if (!chanRow) continue;
+            int slot = table->fIndex.GetSlot(chanRow->GetChannelId());
+            if (slot < 0) continue;
+            table->fStatus[slot] = chanRow->GetChannelStatus();
+        }
+
+        CaptLog("Bad channel table update: " << context);
+
+        return table;
+    }
+
+    // Load the status table for the MC channels.  The index covers every
+    // wire in the detector.
+    std::shared_ptr<const StatusTable>
+    LoadMCStatusTable(const CP::TEventContext& eventContext,
+                      CP::TValidityRange& validity) {
+        CaptLog("Bad channel table update " << eventContext);
+        validity.Reset(eventContext);
+
+        // Make sure the context has a valid time.  Use the current time!
+        // The table is then only used for this run.
+        CP::TEventContext context(eventContext);
+        bool validTime = true;
+        if (context.GetTimeStamp() == CP::TEventContext::Invalid) {
+            std::time_t t2 = std::time(0);
+            context.SetTimeStamp(t2);
+            validTime = false;
+        }
+
+        // Get the bad channel table.
+        CP::TResultSetHandle<CP::TTPC_Bad_Channel_Table> chanTable(context);
+        Int_t numChannels(chanTable.GetNumRows());
+        if (validTime) validity.Restrict(chanTable.GetValidityRec());
+
+        std::shared_ptr<StatusTable> table(new StatusTable);
+        for (int i = 0; i<numChannels; ++i) {
+            const CP::TTPC_Bad_Channel_Table* chanRow = chanTable.GetRow(i);
+            if (!chanRow) continue;
+            table->fIndex.Include(chanRow->GetChannelMCId());
+        }
+        for (int plane = 0; plane < 3; ++plane) {
+            int wires = CP::TGeometryInfo::Get().GetWireCount(plane);
+            for (int wire = 0; wire < wires; ++wire) {
+                table->fIndex.Include(CP::TMCChannelId(0,plane,wire));
+            }
+        }
+        table->fStatus.assign(table->fIndex.GetSize() + 1, 0);
+        for (int i = 0; i<numChannels; ++i) {
+            const CP::TTPC_Bad_Channel_Table* chanRow = chanTable.GetRow(i);
+            if (!chanRow) continue;
+            int slot = table->fIndex.GetSlot(chanRow->GetChannelMCId());
+            if (slot < 0) continue;
+            table->fStatus[slot] = chanRow->GetChannelStatus();
+        }
+
+        return table;
+    }
+
+    // The most recently loaded calibration table.
+    std::shared_ptr<const CalibTable> gCalibTable;
+
+    // A cache for the ASIC and motherboard averages.  The averages are
+    // rebuilt when the calibration table or the channel map changes.
+    struct AverageCache {
+        std::shared_ptr<const CalibTable> fCalib;
+        std::shared_ptr<const CP::TChannelMap> fMap;
+        std::shared_ptr<const AverageTable> fTable;
+    };
+    AverageCache gAverages;
+
+    // A cache for a status table.  The table is reloaded when the context
+    // leaves the validity range, or when the calibration table or channel
+    // map used to fill it changes.
+    struct StatusCache {
+        CP::TValidityRange fValidity;
+        std::shared_ptr<const CalibTable> fCalib;
+        std::shared_ptr<const CP::TChannelMap> fMap;
+        std::shared_ptr<const StatusTable> fTable;
+    };
+    StatusCache gTPCStatus;
+    StatusCache gMCStatus;
+
+    // Get the collection efficiency parameter for an MC wire plane.  The
+    // efficiency is one if the parameter isn't defined.
+    double GetMCEfficiencyParameter(const char* plane) {
+        std::string name("clusterCalib.mc.wire.collection.");
+        name += plane;
+        if (!CP::TRuntimeParameters::Get().HasParameter(name)) return 1.0;
+        return CP::TRuntimeParameters::Get().GetParameterD(name);
+    }
+
+    // The collection efficiencies of the MC wire planes (X, V and U).  The
+    // parameters don't change during a job, so they are only read once.
+    struct MCEfficiencies {
+        MCEfficiencies() {
+            fPlane[0] = GetMCEfficiencyParameter("x");
+            fPlane[1] = GetMCEfficiencyParameter("v");
+            fPlane[2] = GetMCEfficiencyParameter("u");
+        }
+        double fPlane[3];
+    };
+
+    const MCEfficiencies& GetMCEfficiencies() {
+        static const MCEfficiencies efficiencies;
+        return efficiencies;
+    }
+
+    // The names of the datums saved by the MC electronics simulation.
+    const char* gElecSimpleNames[] = {
+        "gain", "shape", "shapeRise", "shapeFall", "digitStep",
+        "triggerOffset", "pedestal", "slope"};
+}
+
+CP::TChannelCalibSnapshot::TChannelCalibSnapshot(const CP::TEvent& event)
+    : fContext(event.GetContext()), fEvent(&event) {
+    Initialize();
+    ReadElecSimple(event);
+}
+
+CP::TChannelCalibSnapshot::TChannelCalibSnapshot(
+    const CP::TEventContext& context)
+    : fContext(context), fEvent(NULL) {
+    Initialize();
+}
+
+CP::TChannelCalibSnapshot::~TChannelCalibSnapshot() { }
+
+void CP::TChannelCalibSnapshot::Initialize() {
+    for (int d = 0; d<kDatums; ++d) {
+        fMCSize[d] = 0;
+        std::fill(fMCValues[d], fMCValues[d]+kMCChannelTypes, 0.0);
+    }
+    fDriftVelocity = 1.6*unit::millimeter/unit::microsecond;
+    fLifetime = 3.14E+8*unit::second;
+    // The efficiencies are only used for the MC channels, so the charge
+    // of the data hits is not scaled.
+    const MCEfficiencies& efficiencies = GetMCEfficiencies();
+    std::copy(efficiencies.fPlane, efficiencies.fPlane+3,
+              fCollectionEfficiency);
+    fCollectionEfficiency[3] = 1.0;
+    for (int p = 0; p<kPlanes+1; ++p) fChargeScale[p] = 1.0;
+    if (fContext.IsMC()) {
+        for (int p = 0; p<kPlanes; ++p) {
+            if (fCollectionEfficiency[p] <= 0.0) continue;
+            fChargeScale[p] = 1.0/fCollectionEfficiency[p];
+        }
+    }
+
+    fCalib = DefaultCalibTable();
+    fAverages = DefaultAverageTable();
+    fTPCStatus = EmptyStatusTable();
+    fMCStatus = EmptyStatusTable();
+    if (!fContext.IsValid()) return;
+
+    // The channel map is needed for the TPC status index, and to group the
+    // TPC channels by ASIC and motherboard.  Get it before taking the table
+    // lock since TChannelInfo has its own lock.
+    std::shared_ptr<const CP::TChannelMap> channelMap;
+    if (!fContext.IsMC()) {
+        channelMap = CP::TChannelInfo::Get().GetChannelMap(fContext);
+    }
+
+    std::lock_guard<std::mutex> lock(gTableMutex);
+
+    if (fContext.IsMC()) {
+        if (!gMCStatus.fTable || !gMCStatus.fValidity.Contains(fContext)) {
+            gMCStatus.fTable = LoadMCStatusTable(fContext,
+                                                 gMCStatus.fValidity);
+        }
+        fMCStatus = gMCStatus.fTable;
+        return;
+    }
+
+    if (!gCalibTable || !gCalibTable->fValidity.Contains(fContext)) {
+        gCalibTable = LoadCalibTable(fContext);
+    }
+    fCalib = gCalibTable;
+
+    if (!gAverages.fTable
+        || gAverages.fCalib != fCalib
+        || gAverages.fMap != channelMap) {
+        gAverages.fCalib = fCalib;
+        gAverages.fMap = channelMap;
+        gAverages.fTable = MakeAverageTable(*fCalib, *channelMap);
+    }
+    fAverages = gAverages.fTable;
+
+    if (!gTPCStatus.fTable
+        || !gTPCStatus.fValidity.Contains(fContext)
+        || gTPCStatus.fCalib != fCalib
+        || gTPCStatus.fMap != channelMap) {
+        gTPCStatus.fCalib = fCalib;
+        gTPCStatus.fMap = channelMap;
+        gTPCStatus.fTable = LoadTPCStatusTable(fContext, *fCalib,
+                                               *channelMap,
+                                               gTPCStatus.fValidity);
+    }
+    fTPCStatus = gTPCStatus.fTable;
+}
+
+void CP::TChannelCalibSnapshot::ReadElecSimple(const CP::TEvent& event) {
+    std::string base("~/truth/elecSimple/");
+    for (int d = 0; d<kDatums; ++d) {
+        std::string name = base + gElecSimpleNames[d];
+        CP::THandle<CP::TRealDatum> datum
+            = event.Get<CP::TRealDatum>(name.c_str());
+        if (!datum) continue;
+        fMCSize[d] = std::min((int) datum->size(), (int) kMCChannelTypes);
+        for (int i = 0; i<fMCSize[d]; ++i) fMCValues[d][i] = (*datum)[i];
+    }
+    CP::THandle<CP::TRealDatum> argon
+        = event.Get<CP::TRealDatum>("~/truth/elecSimple/argon");
+    if (argon && argon->size() >= 2) {
+        fDriftVelocity = (*argon)[0];
+        fLifetime = (*argon)[1];
+    }
+}
+
+int CP::TChannelCalibSnapshot::GetMCChannelType(CP::TChannelId id) {
+    CP::TMCChannelId mc(id);
+    int index = -1;
+    if (mc.GetType() == 0) index = mc.GetSequence();
+    else if (mc.GetType() == 1) index = 3;
+    if (index < 0 || kMCChannelTypes <= index) return -1;
+    return index;
+}
+
+double CP::TChannelCalibSnapshot::GetMCValue(int datum,
+                                             CP::TChannelId id) const {
+    int index = GetMCChannelType(id);
+    if (index < 0 || fMCSize[datum] <= index) return 0.0;
+    return fMCValues[datum][index];
+}
+
+bool CP::TChannelCalibSnapshot::IsKnownChannel(CP::TChannelId id) const {
+    if (!id.IsMCChannel()) return true;
+    return GetMCChannelType(id) >= 0;
+}
+
+bool CP::TChannelCalibSnapshot::HasMCConstant(int datum,
+                                              CP::TChannelId id) const {
+    if (!id.IsMCChannel()) return true;
+    if (datum < 0 || kDatums <= datum) return false;
+    int index = GetMCChannelType(id);
+    return 0 <= index && index < fMCSize[datum];
+}
+
+const char* CP::TChannelCalibSnapshot::GetMCConstantName(int datum) {
+    if (datum < 0 || kDatums <= datum) return "unknown";
+    return gElecSimpleNames[datum];
+}
+
+bool CP::TChannelCalibSnapshot::IsGoodChannel(CP::TChannelId id) const {
+    int status = GetChannelStatus(id);
+    status &= ~(TTPC_Channel_Calib_Table::kLowGain
+                |TTPC_Channel_Calib_Table::kHighGain
+                |TTPC_Channel_Calib_Table::kBadPeak
+                |TTPC_Channel_Calib_Table::kBadFit);
+    return status == 0;
+}
+
+bool CP::TChannelCalibSnapshot::IsGoodWire(CP::TGeometryId geomId) const {
+    if (!geomId.IsValid()) return false;
+    if (!CP::GeomId::Captain::IsWire(geomId)) return false;
+    int run = fContext.IsValid()? fContext.GetRun(): -1;
+    return !CP::TIgnoredWireList::Get().IsIgnored(geomId, run);
+}
+
+double CP::TChannelCalibSnapshot::GetGainConstant(CP::TChannelId id,
+                                                  int order) const {
+    if (order != 1) return 0.0;
+    if (id.IsMCChannel()) return GetMCValue(kGain,id);
+    return fCalib->fGain[fCalib->GetSlot(id)];
+}
+
+double CP::TChannelCalibSnapshot::GetTimeConstant(CP::TChannelId id,
+                                                  int order) const {
+    if (id.IsMCChannel()) {
+        int index = GetMCChannelType(id);
+        double digitStep = GetMCValue(kDigitStep,id);
+        double triggerOffset = GetMCValue(kTriggerOffset,id);
+
+        if (order == 0) {
+            // The offset for the digitization time for each type of MC
+            // channel.  This was determined "empirically", and depends on the
+            // details of the simulation.  It should be in the parameter file.
+            // The exact value depends on the details of the time clustering.
+            double timeOffset = -triggerOffset;
+            if (index == 1) timeOffset += -digitStep + 23*unit::ns;
+            else if (index == 2) timeOffset += -digitStep + 52*unit::ns;
+            return timeOffset;
+        }
+        else if (order == 1) {
+            return digitStep;
+        }
+
+        return 0.0;
+    }
+
+    /// The time offset frore the TPC trigger is fixed to 3200 samples in
+    /// software.  This isn't going to change, so just provide the fixed
+    /// value.  The sample rate of 500 ns/sample is fixed in hardware against
+    /// a very good clock, so it is also fixed.
+    if (order == 0) return -1.600*unit::ms;
+    if (order == 1) return 500.0*unit::ns;
+    return 0.0;
+}
+
+double CP::TChannelCalibSnapshot::GetDigitizerConstant(CP::TChannelId id,
+                                                       int order) const {
+    if (id.IsMCChannel()) {
+        if (order == 0) return GetMCValue(kPedestal,id);
+        else if (order == 1) return GetMCValue(kSlope,id);
+        return 0.0;
+    }
+
+    // This is fixed for the data since we use an injected pulse with a known
+    // charge to calibrate the ASIC and the digitizer as a combined system.
+    // The precise value doesn't matter, so we are using the design spec.  The
+    // actual digitizers vary by about 20%.
+    if (order == 1) return 2.5/unit::mV;
+    else if (order == 0) return fCalib->fPedestal[fCalib->GetSlot(id)];
+    return 0.0;
+}
+
+double CP::TChannelCalibSnapshot::GetPulseShapePeakTime(
+    CP::TChannelId id) const {
+    if (id.IsMCChannel()) return GetMCValue(kShape,id);
+    return fCalib->fPeakTime[fCalib->GetSlot(id)];
+}
+
+double CP::TChannelCalibSnapshot::GetPulseShapeRise(CP::TChannelId id) const {
+    if (id.IsMCChannel()) return GetMCValue(kShapeRise,id);
+    return fCalib->fRise[fCalib->GetSlot(id)];
+}
+
+double CP::TChannelCalibSnapshot::GetPulseShapeFall(CP::TChannelId id) const {
+    if (id.IsMCChannel()) return GetMCValue(kShapeFall,id);
+    return fCalib->fFall[fCalib->GetSlot(id)];
+}
+
+double CP::TChannelCalibSnapshot::GetAveragePulseShapePeakTime(
+    CP::TChannelId id) const {
+    if (id.IsMCChannel()) return GetPulseShapePeakTime(id);
+    return fCalib->fAveragePeakTime;
+}
+
+double CP::TChannelCalibSnapshot::GetAveragePulseShapeRise(
+    CP::TChannelId id) const {
+    if (id.IsMCChannel()) return GetPulseShapeRise(id);
+    return fCalib->fAverageRise;
+}
+
+double CP::TChannelCalibSnapshot::GetAveragePulseShapeFall(
+    CP::TChannelId id) const {
+    if (id.IsMCChannel()) return GetPulseShapeFall(id);
+    return fCalib->fAverageFall;
+}
+
+void CP::TChannelCalibSnapshot::GetCalibRecord(CP::TChannelId id,
+                                               Record& record) const {
+    record.fChannel = id.AsUInt();
+    record.fStatus = GetChannelStatus(id);
+    record.fDigitizerSlope = GetDigitizerConstant(id,1);
+    record.fTimeOffset = GetTimeConstant(id,0);
+    record.fTimeStep = GetTimeConstant(id,1);
+    if (id.IsMCChannel()) {
+        record.fGain = GetGainConstant(id,1);
+        record.fPedestal = GetDigitizerConstant(id,0);
+        record.fPeakTime = GetPulseShapePeakTime(id);
+        record.fRise = GetPulseShapeRise(id);
+        record.fFall = GetPulseShapeFall(id);
+        return;
+    }
+    // Find the slot once for all of the TPC constants.
+    int slot = fCalib->GetSlot(id);
+    record.fGain = fCalib->fGain[slot];
+    record.fPedestal = fCalib->fPedestal[slot];
+    record.fPeakTime = fCalib->fPeakTime[slot];
+    record.fRise = fCalib->fRise[slot];
+    record.fFall = fCalib->fFall[slot];
+}
+
+void CP::TChannelCalibSnapshot::GetCalibRecord(const CP::TChannelId* ids,
+                                               int n,
+                                               Record* records) const {
+    for (int i = 0; i<n; ++i) GetCalibRecord(ids[i], records[i]);
+}
+
+double CP::TChannelCalibSnapshot::GetCollectionEfficiency(
+    CP::TChannelId id) const {
+    if (!id.IsMCChannel()) return 1.0;
+    return GetPlaneCollectionEfficiency(GetMCChannelType(id));
+}
+
+void CP::TChannelCalibSnapshot::CorrectCharge(int plane,
+                                              const double* driftTimes,
+                                              int n,
+                                              double* charges) const {
+    if (plane < 0 || kPlanes <= plane) plane = kPlanes;
+    double scale = fChargeScale[plane];
+    double inverseLifetime = (fLifetime > 0.0)? 1.0/fLifetime: 0.0;
+    for (int i = 0; i<n; ++i) {
+        charges[i] *= scale*std::exp(driftTimes[i]*inverseLifetime);
+    }
+}
+
+void CP::TChannelCalibSnapshot::CorrectCharge(const int* planes,
+                                              const double* driftTimes,
+                                              int n,
+                                              double* charges) const {
+    double inverseLifetime = (fLifetime > 0.0)? 1.0/fLifetime: 0.0;
+    for (int i = 0; i<n; ++i) {
+        unsigned int plane = planes[i];
+        plane = (plane < (unsigned int) kPlanes)? plane: kPlanes;
+        charges[i] *= fChargeScale[plane]
+            *std::exp(driftTimes[i]*inverseLifetime);
+    }
+}
+
+void CP::TChannelCalibSnapshot::GetCalibRecord(CP::TChannelId id,
+                                               Record& record,
+                                               Fallback fallback) const {
+    GetCalibRecord(id, record);
+    if (fallback == kNoFallback) return;
+    if (id.IsMCChannel()) return;
+    if (!(record.fStatus & (TTPC_Channel_Calib_Table::kBadFit
+                            |TTPC_Channel_Calib_Table::kBadPeak))) {
+        return;
+    }
+    Average average;
+    if (fallback == kASICFallback) average = GetASICAverage(id);
+    else if (fallback == kMotherboardFallback) {
+        average = GetMotherboardAverage(id);
+    }
+    else average = GetDetectorAverage(id);
+    // Keep the channel constants if there aren't any good channels.
+    if (average.fChannels < 1) return;
+    record.fGain = average.fGain;
+    record.fPeakTime = average.fPeakTime;
+    record.fRise = average.fRise;
+    record.fFall = average.fFall;
+}
+
+CP::TChannelCalibSnapshot::Average
+CP::TChannelCalibSnapshot::GetMCAverage(CP::TChannelId id) const {
+    Average average;
+    average.fGain = GetGainConstant(id,1);
+    average.fPeakTime = GetPulseShapePeakTime(id);
+    average.fRise = GetPulseShapeRise(id);
+    average.fFall = GetPulseShapeFall(id);
+    average.fChannels = 1;
+    return average;
+}
+
+CP::TChannelCalibSnapshot::Average
+CP::TChannelCalibSnapshot::GetASICAverage(CP::TChannelId id) const {
+    if (id.IsMCChannel()) return GetMCAverage(id);
+    int group = fAverages->fASIC[fCalib->GetSlot(id)];
+    if (group >= 0 && fAverages->fASICAverage[group].fChannels > 0) {
+        return fAverages->fASICAverage[group];
+    }
+    return GetMotherboardAverage(id);
+}
+
+CP::TChannelCalibSnapshot::Average
+CP::TChannelCalibSnapshot::GetMotherboardAverage(CP::TChannelId id) const {
+    if (id.IsMCChannel()) return GetMCAverage(id);
+    int group = fAverages->fMotherboard[fCalib->GetSlot(id)];
+    if (group >= 0 && fAverages->fMotherboardAverage[group].fChannels > 0) {
+        return fAverages->fMotherboardAverage[group];
+    }
+    return fAverages->fDetectorAverage;
+}
+
+CP::TChannelCalibSnapshot::Average
+CP::TChannelCalibSnapshot::GetDetectorAverage(CP::TChannelId id) const {
+    if (id.IsMCChannel()) return GetMCAverage(id);
+    return fAverages->fDetectorAverage;
+}
@@ -0,0 +1,404 @@
+#ifndef TChannelCalibSnapshot_hxx_seen
+#define TChannelCalibSnapshot_hxx_seen
+
+#include <TEventContext.hxx>
+#include <TChannelId.hxx>
+#include <TGeometryId.hxx>
+
+#include "TChannelIndex.hxx"
+#include "TValidityRange.hxx"
+
+#include <vector>
+#include <memory>
+
+namespace CP {
+    class TChannelCalibSnapshot;
+    class TEvent;
+};
+
+/// The calibration constants for an event context.  The snapshot is created
+/// from an explicit event context (or from an event) and holds all of the
+/// tables needed to calibrate the channels, so the constants are found
+/// without looking up the current event, or accessing the database.  The
+/// snapshot is immutable after it is created, so the getters can be called
+/// from any thread, and a thread can keep a snapshot as a handle for the
+/// events it is calibrating.  The getters never throw.  Channels that are
+/// not known get the default constants (zero for an unknown MC channel).
+///
+/// The tables are shared between snapshots for contexts in the same
+/// validity range, so creating a snapshot for each event only accesses the
+/// database when the validity range changes.
+///
+/// \code
+/// CP::TChannelCalibSnapshot calib(*event);
+/// double gain = calib.GetGainConstant(id);
+/// \endcode
+///
+/// CP::TChannelCalib provides the same constants for the current event.
+class CP::TChannelCalibSnapshot {
+public:
+    /// The constants saved for each type of MC channel by the electronics
+    /// simulation (the ~/truth/elecSimple datums).  See HasMCConstant().
+    enum {kGain, kShape, kShapeRise, kShapeFall, kDigitStep,
+          kTriggerOffset, kPedestal, kSlope, kDatums};
+
+    /// The status of all of the channels in the detector.  The status for a
+    /// channel is saved in the slot given by the index, and the last entry
+    /// is the status of channels that are not covered by the index.
+    struct StatusTable {
+        StatusTable() : fStatus(1,0) {}
+
+        /// Get the status for a channel.  This is the same as
+        /// GetChannelStatus().
+        int GetStatus(CP::TChannelId id) const {
+            int slot = fIndex.GetSlot(id);
+            if (slot < 0) return fStatus.back();
+            return fStatus[slot];
+        }
+
+        /// The index used to find the slot for a channel.
+        CP::TChannelIndex fIndex;
+
+        /// The status for each slot.
+        std::vector<int> fStatus;
+    };
+
+    /// The TPC pulse gain and shape calibration table.  The values are saved
+    /// in flat arrays indexed by the channel slot.  The last slot holds the
+    /// default values that are used for channels that are not in the table.
+    struct CalibTable {
+        CalibTable()
+            : fRows(0), fChannels(0), fAveragePeakTime(0), fAverageRise(0),
+              fAverageFall(0) {}
+
+        /// Get the slot for a channel.  Channels not in the table get the
+        /// default slot.
+        int GetSlot(CP::TChannelId id) const {
+            int slot = fIndex.GetSlot(id);
+            if (slot < 0) return fIndex.GetSize();
+            return slot;
+        }
+
+        /// The range of contexts where the table is valid.
+        CP::TValidityRange fValidity;
+
+        /// The index for the channels in the table.
+        CP::TChannelIndex fIndex;
+
+        /// The number of rows in the table.
+        int fRows;
+
+        /// The number of channels found in the table.
+        int fChannels;
+
+        /// The values for each slot.
+        /// @{
+        std::vector<int> fStatus;
+        std::vector<double> fGain;
+        std::vector<double> fPeakTime;
+        std::vector<double> fRise;
+        std::vector<double> fFall;
+        std::vector<double> fPedestal;
+        /// @}
+
+        /// This is one for the slots that were filled from a row of the
+        /// table.  Slots in the index box that don't have a row (and the
+        /// default slot) are zero.
+        std::vector<unsigned char> fFound;
+
+        /// The averages over all of the rows in the table.
+        /// @{
+        double fAveragePeakTime;
+        double fAverageRise;
+        double fAverageFall;
+        /// @}
+    };
+
+    /// The average of the gain and pulse shape over a group of channels.
+    struct Average {
+        Average()
+            : fGain(0), fPeakTime(0), fRise(0), fFall(0), fChannels(0) {}
+        double fGain;
+        double fPeakTime;
+        double fRise;
+        double fFall;
+        /// The number of channels in the average.  This is zero if the
+        /// group doesn't have any well calibrated channels.
+        int fChannels;
+    };
+
+    /// The averages of the TPC constants for each cold ASIC and cold
+    /// motherboard.  The group for each slot of the CalibTable is saved, so
+    /// the average for a channel is found with two array reads.  Only the
+    /// channels with a good calibration fit are included in the averages.
+    struct AverageTable {
+        /// The ASIC group for each slot of the CalibTable, or -1.
+        std::vector<int> fASIC;
+
+        /// The motherboard group for each slot of the CalibTable, or -1.
+        std::vector<int> fMotherboard;
+
+        /// The average for each ASIC group.
+        std::vector<Average> fASICAverage;
+
+        /// The average for each motherboard group.
+        std::vector<Average> fMotherboardAverage;
+
+        /// The average over the detector.
+        Average fDetectorAverage;
+    };
+
+    /// The averages that are used in place of the constants for a channel
+    /// when the calibration fit for the channel failed (kBadFit or
+    /// kBadPeak).  If the group doesn't have any well calibrated channels,
+    /// then the next larger group is used.
+    enum Fallback {
+        /// Always use the constants for the channel.
+        kNoFallback,
+        /// Use the ASIC, motherboard, and then detector average.
+        kASICFallback,
+        /// Use the motherboard, and then detector average.
+        kMotherboardFallback,
+        /// Use the detector average.
+        kDetectorFallback
+    };
+
+    /// All of the calibration constants for a channel.  This is filled with
+    /// a single call to GetCalibRecord(), so a calibration pass can find
+    /// everything it needs for a channel without a lookup for each constant.
+    struct Record {
+        /// The electronics channel as CP::TChannelId::AsUInt().
+        UInt_t fChannel;
+        /// The status flags (see GetChannelStatus()).
+        int fStatus;
+        /// The linear gain (GetGainConstant(id,1)).
+        double fGain;
+        /// The digitizer pedestal (GetDigitizerConstant(id,0)).
+        double fPedestal;
+        /// The digitizer slope (GetDigitizerConstant(id,1)).
+        double fDigitizerSlope;
+        /// The time of the first sample (GetTimeConstant(id,0)).
+        double fTimeOffset;
+        /// The time per sample (GetTimeConstant(id,1)).
+        double fTimeStep;
+        /// The pulse shape (GetPulseShapePeakTime(), GetPulseShapeRise()
+        /// and GetPulseShapeFall()).
+        /// @{
+        double fPeakTime;
+        double fRise;
+        double fFall;
+        /// @}
+
+        /// Get the channel identifier.
+        CP::TChannelId GetChannelId() const {
+            return CP::TChannelId(fChannel);
+        }
+    };
+
+    /// Create a snapshot for an event.  This includes the constants for the
+    /// MC electronics simulation that are saved in the event.
+    explicit TChannelCalibSnapshot(const CP::TEvent& event);
+
+    /// Create a snapshot for an event context.  The MC electronics
+    /// simulation constants are saved in the event, so they are not
+    /// available, and the MC channels will have zero for those constants.
+    explicit TChannelCalibSnapshot(const CP::TEventContext& context);
+
+    ~TChannelCalibSnapshot();
+
+    /// Get the event context for the snapshot.
+    const CP::TEventContext& GetContext() const {return fContext;}
+
+    /// Get the event that the snapshot was created from.  This is only used
+    /// to check if the snapshot is for a particular event, and is NULL if
+    /// the snapshot was created from a context.
+    const CP::TEvent* GetEvent() const {return fEvent;}
+
+    /// This is true if the type of an MC channel is known.  The TPC
+    /// channels are always known since they get the default constants.  The
+    /// constants from the MC electronics simulation are zero if they were
+    /// not found in the event.
+    bool IsKnownChannel(CP::TChannelId id) const;
+
+    /// This is true if an MC electronics simulation constant (e.g. kGain)
+    /// was found in the event for a channel.  The TPC channels always have
+    /// their constants.  The getters return zero for a missing constant.
+    bool HasMCConstant(int datum, CP::TChannelId id) const;
+
+    /// Get the name of the ~/truth/elecSimple datum for an MC electronics
+    /// simulation constant.
+    static const char* GetMCConstantName(int datum);
+
+    /// The status flags for a channel.  See CP::TChannelCalib.
+    int GetChannelStatus(CP::TChannelId id) const {
+        if (id.IsMCChannel()) return fMCStatus->GetStatus(id);
+        return fTPCStatus->GetStatus(id);
+    }
+
+    /// This is true if the channel is considered good.  See
+    /// CP::TChannelCalib.
+    bool IsGoodChannel(CP::TChannelId id) const;
+
+    /// This is true if the wire is working for the run of the snapshot.
+    /// See CP::TChannelCalib.
+    bool IsGoodWire(CP::TGeometryId id) const;
+
+    /// The status of all of the channels in the detector.  This is the
+    /// status of the MC channels for an MC context, and of the TPC channels
+    /// otherwise.
+    const StatusTable& GetDetectorStatus() const {
+        if (fContext.IsMC()) return *fMCStatus;
+        return *fTPCStatus;
+    }
+
+    /// The calibration constants for a channel.  See CP::TChannelCalib for
+    /// the definitions.
+    /// @{
+    double GetGainConstant(CP::TChannelId id, int order=1) const;
+    double GetTimeConstant(CP::TChannelId id, int order=1) const;
+    double GetDigitizerConstant(CP::TChannelId id, int order=1) const;
+    double GetPulseShapePeakTime(CP::TChannelId id) const;
+    double GetPulseShapeRise(CP::TChannelId id) const;
+    double GetPulseShapeFall(CP::TChannelId id) const;
+    double GetAveragePulseShapePeakTime(CP::TChannelId id) const;
+    double GetAveragePulseShapeRise(CP::TChannelId id) const;
+    double GetAveragePulseShapeFall(CP::TChannelId id) const;
+    double GetElectronLifetime() const {return fLifetime;}
+    double GetElectronDriftVelocity() const {return fDriftVelocity;}
+    double GetCollectionEfficiency(CP::TChannelId id) const;
+    /// @}
+
+    /// Get the collection efficiency for a plane.  The planes are numbered
+    /// like GetMCChannelType() (X, V, U and then the PMTs).  The efficiencies
+    /// are read once from the clusterCalib.mc.wire.collection parameters,
+    /// and copied into each snapshot.  The efficiency of the
+    /// data channels is always one (see GetCollectionEfficiency()).
+    double GetPlaneCollectionEfficiency(int plane) const {
+        if (plane < 0 || kPlanes <= plane) return 1.0;
+        return fCollectionEfficiency[plane];
+    }
+
+    /// \name Charge correction
+    /// Correct an array of "n" hit charges for the attenuation during the
+    /// drift, and for the collection efficiency of the plane, so that each
+    /// charge is multiplied by exp(t/lifetime)/efficiency, where t is the
+    /// drift time of the hit.  The efficiency is only applied for MC
+    /// contexts (it is one for data).  The charges are corrected in place.
+    /// The first form is for hits on the same plane, and the second has the
+    /// plane for each hit.  The loops don't branch, so they are vectorized.
+    /// @{
+    void CorrectCharge(int plane, const double* driftTimes, int n,
+                       double* charges) const;
+    void CorrectCharge(const int* planes, const double* driftTimes, int n,
+                       double* charges) const;
+    /// @}
+
+    /// Fill the record with all of the constants for a channel.
+    void GetCalibRecord(CP::TChannelId id, Record& record) const;
+
+    /// Fill the records for a contiguous array of "n" channels.
+    void GetCalibRecord(const CP::TChannelId* ids, int n,
+                        Record* records) const;
+
+    /// Fill the record for a channel, and replace the gain and pulse shape
+    /// with an average if the calibration fit for the channel failed.
+    void GetCalibRecord(CP::TChannelId id, Record& record,
+                        Fallback fallback) const;
+
+    /// Get the average constants for the cold ASIC, cold motherboard or
+    /// detector of a channel.  If the ASIC doesn't have any well calibrated
+    /// channels (or isn't known), then this is the motherboard average, and
+    /// if the motherboard doesn't, then it is the detector average.  The MC
+    /// channels are not grouped, so they get their own constants.
+    /// @{
+    Average GetASICAverage(CP::TChannelId id) const;
+    Average GetMotherboardAverage(CP::TChannelId id) const;
+    Average GetDetectorAverage(CP::TChannelId id) const;
+    /// @}
+
+    /// Get the TPC calibration table.  The table is shared by the snapshots
+    /// for contexts in the same validity range, so the pointer can be used
+    /// to check if the table has changed.
+    const std::shared_ptr<const CalibTable>& GetCalibTable() const {
+        return fCalib;
+    }
+
+    /// Get the ASIC and motherboard averages of the TPC calibration table.
+    const std::shared_ptr<const AverageTable>& GetAverageTable() const {
+        return fAverages;
+    }
+
+    /// Get the status table for the channels in the detector (see
+    /// GetDetectorStatus()).  The pointer can be used to check if the table
+    /// has changed.
+    const std::shared_ptr<const StatusTable>& GetStatusTable() const {
+        if (fContext.IsMC()) return fMCStatus;
+        return fTPCStatus;
+    }
+
+    /// Get the index of the type of an MC channel.  The X, V and U wires are
+    /// 0, 1, and 2, and the PMTs are 3.  This returns -1 if the type isn't
+    /// known.
+    static int GetMCChannelType(CP::TChannelId id);
+
+private:
+    /// The number of types of MC channel.
+    enum {kMCChannelTypes = 4};
+
+    /// The number of planes with a collection efficiency.  This is the same
+    /// as the number of types of MC channel.
+    enum {kPlanes = kMCChannelTypes};
+
+    /// Find the tables for the context.
+    void Initialize();
+
+    /// Read the MC electronics simulation constants from an event.
+    void ReadElecSimple(const CP::TEvent& event);
+
+    /// Get the constants for an MC channel as an average.
+    Average GetMCAverage(CP::TChannelId id) const;
+
+    /// Get an MC electronics simulation constant for a channel.  This
+    /// returns zero if the constant isn't available.
+    double GetMCValue(int datum, CP::TChannelId id) const;
+
+    /// The event context for the snapshot.
+    CP::TEventContext fContext;
+
+    /// The event used to create the snapshot (or NULL).
+    const CP::TEvent* fEvent;
+
+    /// The TPC calibration table.  This is never NULL.
+    std::shared_ptr<const CalibTable> fCalib;
+
+    /// The averages of the TPC calibration table.  This is never NULL.
+    std::shared_ptr<const AverageTable> fAverages;
+
+    /// The status of the TPC channels.  This is never NULL.
+    std::shared_ptr<const StatusTable> fTPCStatus;
+
+    /// The status of the MC channels.  This is never NULL.
+    std::shared_ptr<const StatusTable> fMCStatus;
+
+    /// The MC electronics simulation constants for each type of channel.
+    double fMCValues[kDatums][kMCChannelTypes];
+
+    /// The number of MC values found for each datum.  This is zero if the
+    /// datum isn't in the event.
+    int fMCSize[kDatums];
+
+    /// The argon properties.
+    /// @{
+    double fDriftVelocity;
+    double fLifetime;
+    /// @}
+
+    /// The collection efficiency for each plane of MC channels.
+    double fCollectionEfficiency[kPlanes];
+
+    /// The charge correction factor for each plane (the inverse of the
+    /// collection efficiency for MC, and one for data).  The last entry is
+    /// used for the hits with an invalid plane.
+    double fChargeScale[kPlanes+1];
+};
+#endif
@@ -0,0 +1,98 @@
+#include "TChannelIndex.hxx"
+
+#include <TChannelId.hxx>
+#include <TTPCChannelId.hxx>
+#include <TMCChannelId.hxx>
+
+CP::TChannelIndex::Range::Range() : fSize(0) {
+    for (int i=0; i<3; ++i) {
+        fFirst[i] = 0;
+        fCount[i] = 0;
+    }
+}
+
+void CP::TChannelIndex::Range::Include(int a, int b, int c) {
+    int field[3] = {a, b, c};
+    if (fSize < 1) {
+        for (int i=0; i<3; ++i) {
+            fFirst[i] = field[i];
+            fCount[i] = 1;
+        }
+        fSize = 1;
+        return;
+    }
+    for (int i=0; i<3; ++i) {
+        int last = fFirst[i] + fCount[i] - 1;
+        if (field[i] < fFirst[i]) fFirst[i] = field[i];
+        if (last < field[i]) last = field[i];
+        fCount[i] = last - fFirst[i] + 1;
+    }
+    fSize = fCount[0]*fCount[1]*fCount[2];
+}
+
+int CP::TChannelIndex::Range::GetOffset(int a, int b, int c) const {
+    a -= fFirst[0];
+    if (a < 0 || fCount[0] <= a) return -1;
+    b -= fFirst[1];
+    if (b < 0 || fCount[1] <= b) return -1;
+    c -= fFirst[2];
+    if (c < 0 || fCount[2] <= c) return -1;
+    return (a*fCount[1] + b)*fCount[2] + c;
+}
+
+CP::TChannelIndex::TChannelIndex() {}
+
+void CP::TChannelIndex::Clear() {
+    fTPC = Range();
+    fMC = Range();
+}
+
+void CP::TChannelIndex::Include(CP::TChannelId id) {
+    if (!id.IsValid()) return;
+    if (id.IsMCChannel()) {
+        CP::TMCChannelId mc(id);
+        fMC.Include(mc.GetType(), mc.GetSequence(), mc.GetNumber());
+        return;
+    }
+    CP::TTPCChannelId tpc(id);
+    if (!tpc.IsValid()) return;
+    fTPC.Include(tpc.GetCrate(), tpc.GetFEM(), tpc.GetChannel());
+}
+
+int CP::TChannelIndex::GetSlot(CP::TChannelId id) const {
+    if (id.IsMCChannel()) {
+        if (fMC.fSize < 1) return -1;
+        CP::TMCChannelId mc(id);
+        int offset = fMC.GetOffset(mc.GetType(),
+                                   mc.GetSequence(),
+                                   mc.GetNumber());
+        if (offset < 0) return -1;
+        return fTPC.fSize + offset;
+    }
+    if (fTPC.fSize < 1) return -1;
+    CP::TTPCChannelId tpc(id);
+    if (!tpc.IsValid()) return -1;
+    return fTPC.GetOffset(tpc.GetCrate(), tpc.GetFEM(), tpc.GetChannel());
+}
+
+CP::TChannelId CP::TChannelIndex::GetChannel(int slot) const {
+    if (slot < 0) return CP::TChannelId();
+    if (slot < fTPC.fSize) {
+        int c = slot % fTPC.fCount[2];
+        int b = (slot / fTPC.fCount[2]) % fTPC.fCount[1];
+        int a = slot / (fTPC.fCount[2]*fTPC.fCount[1]);
+        return CP::TTPCChannelId(fTPC.fFirst[0] + a,
+                                 fTPC.fFirst[1] + b,
+                                 fTPC.fFirst[2] + c);
+    }
+    slot -= fTPC.fSize;
+    if (slot < fMC.fSize) {
+        int c = slot % fMC.fCount[2];
+        int b = (slot / fMC.fCount[2]) % fMC.fCount[1];
+        int a = slot / (fMC.fCount[2]*fMC.fCount[1]);
+        return CP::TMCChannelId(fMC.fFirst[0] + a,
+                                fMC.fFirst[1] + b,
+                                fMC.fFirst[2] + c);
+    }
+    return CP::TChannelId();
+}
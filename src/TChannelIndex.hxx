@@ -0,0 +1,66 @@
+#ifndef TChannelIndex_hxx_seen
+#define TChannelIndex_hxx_seen
+
+#include <TChannelId.hxx>
+
+namespace CP {
+    class TChannelIndex;
+};
+
+/// A dense index for electronics channel identifiers.  The TPC channels are
+/// decomposed into crate, FEM and channel, and the MC channels are
+/// decomposed into type, sequence and number.  Each channel inside of the
+/// range of fields that have been included is assigned a "slot" between
+/// zero and GetSize()-1, so information about channels can be saved in flat
+/// arrays and found without searching.  The index is built by calling
+/// Include() for every channel that needs to be covered, and then the size
+/// of the arrays is given by GetSize().  Including a new channel will
+/// usually change the slot assignments, so all of the channels need to be
+/// included before any arrays are filled.
+class CP::TChannelIndex {
+public:
+    TChannelIndex();
+
+    /// Remove all of the channels from the index.
+    void Clear();
+
+    /// Extend the index so that it covers the channel.  Channels that are
+    /// neither TPC nor MC channels are ignored.
+    void Include(CP::TChannelId id);
+
+    /// Get the number of slots in the index.
+    int GetSize() const {return fTPC.fSize + fMC.fSize;}
+
+    /// Get the slot for a channel.  This returns -1 if the channel is not
+    /// covered by the index.
+    int GetSlot(CP::TChannelId id) const;
+
+    /// Get the channel for a slot.  This returns an invalid channel if the
+    /// slot is out of range.
+    CP::TChannelId GetChannel(int slot) const;
+
+private:
+    /// The range of the fields for one type of channel.  The fields are
+    /// (crate, fem, channel) for the TPC and (type, sequence, number) for the
+    /// MC.
+    struct Range {
+        Range();
+        /// Extend the range to include the fields.
+        void Include(int a, int b, int c);
+        /// Get the offset of the fields inside of the range, or -1.
+        int GetOffset(int a, int b, int c) const;
+        /// The first value of each field.
+        int fFirst[3];
+        /// The number of values of each field.
+        int fCount[3];
+        /// The total number of slots in the range.
+        int fSize;
+    };
+
+    /// The range covered by the TPC channels.  These are the first slots.
+    Range fTPC;
+
+    /// The range covered by the MC channels.  These follow the TPC slots.
+    Range fMC;
+};
+#endif
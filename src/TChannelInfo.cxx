@@ -1,6 +1,7 @@
 #include "TChannelInfo.hxx"
 
 #include <TCaptLog.hxx>
+#include <TRuntimeParameters.hxx>
 #include <CaptGeomId.hxx>
 #include <TChannelId.hxx>
 #include <TMCChannelId.hxx>
@@ -12,25 +13,44 @@
 #include <TTPC_Wire_Geometry_Table.hxx>
 
 #include <TResultSetHandle.hxx>
+#include <TDbiValidityRec.hxx>
 #include <DatabaseUtils.hxx>
 
 #include <TSystem.h>
 
-#include <fstream>
 #include <string>
-#include <sstream>
+
+namespace {
+    // Make sure the singleton is only created once.
+    std::once_flag gChannelInfoOnce;
+
+    // The thread local copy of the most recently published map, and the
+    // generation when it was copied.
+    thread_local std::shared_ptr<const CP::TChannelMap> gThreadMap;
+    thread_local unsigned int gThreadGeneration = 0;
+}
 
 // Initialize the singleton pointer.
 CP::TChannelInfo* CP::TChannelInfo::fChannelInfo = NULL;
 
 CP::TChannelInfo& CP::TChannelInfo::Get() {
-    if (!fChannelInfo) {
-        fChannelInfo = new CP::TChannelInfo();
-    }
+    std::call_once(gChannelInfoOnce,
+                   [] () {fChannelInfo = new CP::TChannelInfo();});
     return *fChannelInfo;
 }
 
-CP::TChannelInfo::TChannelInfo() {
+CP::TChannelInfo::TChannelInfo()
+    : fMap(new CP::TChannelMap), fGeneration(1), fAdjacencyRun(-1),
+      fCacheCapacity(4), fCacheHits(0), fCacheMisses(0) {
+    fEmptyMap = fMap;
+    fPublished = fMap;
+
+    if (CP::TRuntimeParameters::Get().HasParameter(
+            "captChanInfo.cache.capacity")) {
+        SetCacheCapacity(CP::TRuntimeParameters::Get().GetParameterI(
+                             "captChanInfo.cache.capacity"));
+    }
+
     const char* envVal = gSystem->Getenv("CAPTCHANNELMAP");
     if (!envVal) return;
 
@@ -38,106 +58,154 @@ CP::TChannelInfo::TChannelInfo() {
 
     if (mapName.empty()) return;
 
-    // Attach the file to a stream.
-    std::ifstream mapFile(mapName.c_str());
-    std::string line;
-    while (std::getline(mapFile,line)) {
-        std::size_t comment = line.find("#");
-        std::string tmp = line;
-        if (comment != std::string::npos) tmp.erase(comment);
-        // The minimum valid date, time and hash is 22 characters.  
-        if (tmp.size()<20) continue;
-        std::istringstream parser(tmp);
-        int crate;
-        int fem;
-        int channel;
-        int detector;
-        int plane;
-        int wire;
-        
-        parser >> crate;
-        if (parser.fail()) {
-            CaptError("Could not parse crate number: "<< line);
-            continue;
-        }
-
-        parser >> fem;
-        if (parser.fail()) {
-            CaptError("Could not parse fem number: "<< line);
-            continue;
-        }
+    // The override can either be a text file, or a compiled binary file.
+    if (!fOverride.Open(mapName)) {
+        CaptError("Unable to read CAPTCHANNELMAP file " << mapName);
+    }
+}
 
-        parser >> channel;
-        if (parser.fail()) {
-            CaptError("Could not parse channel number: "<< line);
-            continue;
-        }
+void CP::TChannelInfo::SetContext(const CP::TEventContext& context) {
+    std::lock_guard<std::mutex> lock(fMutex);
 
-        parser >> detector;
-        if (parser.fail()) {
-            CaptError("Could not parse detector number: "<< line);
-            continue;
-        }
+    if (context == fContext) {
+        CaptNamedInfo("TChannelInfo","context: " << context << " (no change)");
+        return;
+    }
 
-        parser >> plane;
-        if (parser.fail()) {
-            CaptError("Could not parse plane number: "<< line);
-            continue;
-        }
+    fContext = context;
 
-        parser >> wire;
-        if (parser.fail()) {
-            CaptError("Could not parse wire number: "<< line);
-            continue;
-        }
+    if (!fContext.IsValid()) {
+        CaptError("New event context is not valid: " << context);
+    }
 
-        CP::TChannelId cid;
-        CP::TGeometryId gid;
-        if (detector == CP::TChannelId::kTPC) {
-            cid = CP::TTPCChannelId(crate,fem,channel);
-            gid = CP::GeomId::Captain::Wire(plane,wire);
-        }
-        else {
-            CaptError("Unknown detector channel: " << line);
-            continue;
-        }
+    Publish(FindMap(fContext));
+}
 
-        if (fChannelMap.find(cid) != fChannelMap.end()) {
-            CaptError("Channel already exists: " << line);
-            CaptError("   Duplicate " << gid);
-        }
+std::shared_ptr<const CP::TChannelMap>
+CP::TChannelInfo::GetChannelMap(const CP::TEventContext& context) {
+    std::lock_guard<std::mutex> lock(fMutex);
+    return FindMap(context);
+}
 
-        if (fGeometryMap.find(gid) != fGeometryMap.end()) {
-            CaptError("Channel already exists: " << line);
-            CaptError("   Duplicate " << cid);
+std::shared_ptr<const CP::TChannelMap>
+CP::TChannelInfo::FindMap(const CP::TEventContext& context) {
+    if (!context.IsValid()) return fEmptyMap;
+    
+    if (context.IsMC()) {
+        if (!fMCMap) {
+            std::shared_ptr<CP::TChannelMap> mcMap(new CP::TChannelMap);
+            CP::TValidityRange validity;
+            validity.Reset(context);
+            mcMap->SetContext(context);
+            mcMap->SetValidity(validity);
+            fMCMap = mcMap;
         }
+        return fMCMap;
+    }
 
-        fChannelMap[cid] = gid;
-        fGeometryMap[gid] = cid;
+    // Only change the mapping when the context has moved outside of the
+    // validity range of the current map.  This will usually only happen
+    // when the run changes.
+    if (fMap->GetValidity().Contains(context)) {
+        CaptNamedInfo("TChannelInfo","context: " << context << " (valid)");
+        return fMap;
+    }
 
+    // Check if a recently used map is valid for the new context, and move it
+    // to the front of the cache.
+    for (std::list< std::shared_ptr<const CP::TChannelMap> >::iterator m
+             = fCache.begin();
+         m != fCache.end(); ++m) {
+        if (!(*m)->GetValidity().Contains(context)) continue;
+        CaptNamedInfo("TChannelInfo","context: " << context << " (cached)");
+        fCache.splice(fCache.begin(), fCache, m);
+        ++fCacheHits;
+        return fCache.front();
     }
+
+    CaptNamedInfo("TChannelInfo","context: " << context << " (change)");
+    ++fCacheMisses;
+    fCache.push_front(LoadMap(context));
+    while ((int) fCache.size() > fCacheCapacity) fCache.pop_back();
+    return fCache.front();
 }
 
-void CP::TChannelInfo::SetContext(const CP::TEventContext& context) {
+std::shared_ptr<const CP::TWireAdjacency>
+CP::TChannelInfo::GetWireAdjacency(const CP::TEventContext& context) {
+    std::lock_guard<std::mutex> lock(fMutex);
+    std::shared_ptr<const CP::TChannelMap> channelMap = FindMap(context);
+    int run = context.IsValid()? context.GetRun(): -1;
+    if (fAdjacency && fAdjacencyMap == channelMap && fAdjacencyRun == run) {
+        return fAdjacency;
+    }
+    std::shared_ptr<CP::TWireAdjacency> adjacency(new CP::TWireAdjacency);
+    adjacency->Build(*channelMap, run);
+    fAdjacency = adjacency;
+    fAdjacencyMap = channelMap;
+    fAdjacencyRun = run;
+    return fAdjacency;
+}
 
-    if (context == fContext) {
-        CaptNamedInfo("TChannelInfo","context: " << context << " (no change)");
-        return;
+void CP::TChannelInfo::Publish(
+    const std::shared_ptr<const CP::TChannelMap>& map) {
+    if (map == fMap) return;
+    fMap = map;
+    std::atomic_store(&fPublished, map);
+    fGeneration.fetch_add(1, std::memory_order_release);
+}
+
+const CP::TChannelMap& CP::TChannelInfo::CurrentMap() const {
+    unsigned int generation = fGeneration.load(std::memory_order_acquire);
+    if (generation != gThreadGeneration) {
+        gThreadMap = std::atomic_load(&fPublished);
+        gThreadGeneration = generation;
     }
+    return *gThreadMap;
+}
 
-    // This needs to check if a new mapping needs to be loaded.
-    fContext = context;
-    CaptNamedInfo("TChannelInfo","context: " << context << " (change)");
+void CP::TChannelInfo::AddChannelMap(
+    const std::shared_ptr<const CP::TChannelMap>& map) {
+    if (!map) return;
+    std::lock_guard<std::mutex> lock(fMutex);
+    fCache.remove(map);
+    fCache.push_front(map);
+    while ((int) fCache.size() > fCacheCapacity) fCache.pop_back();
+}
 
-    if (!fContext.IsValid()) {
-        CaptError("New event context is not valid: " << context);
-        return;
-    }
-    
-    if (fContext.IsMC()) {
-        return;
+int CP::TChannelInfo::GetCacheSize() const {
+    std::lock_guard<std::mutex> lock(fMutex);
+    return fCache.size();
+}
+
+void CP::TChannelInfo::SetCacheCapacity(int capacity) {
+    std::lock_guard<std::mutex> lock(fMutex);
+    if (capacity < 1) capacity = 1;
+    fCacheCapacity = capacity;
+    while ((int) fCache.size() > fCacheCapacity) fCache.pop_back();
+}
+
+std::size_t CP::TChannelInfo::GetCacheMemoryUsage() const {
+    std::lock_guard<std::mutex> lock(fMutex);
+    std::size_t size = 0;
+    for (std::list< std::shared_ptr<const CP::TChannelMap> >::const_iterator m
+             = fCache.begin();
+         m != fCache.end(); ++m) {
+        size += (*m)->GetMemoryUsage();
     }
-    
+    return size;
+}
+
+std::shared_ptr<const CP::TChannelMap>
+CP::TChannelInfo::LoadMap(const CP::TEventContext& context) {
+    std::shared_ptr<CP::TChannelMap> channelMap(new CP::TChannelMap);
+    channelMap->SetContext(context);
+
+    // Start with a range covering the current run.  It is narrowed to the
+    // validity ranges of the channel and geometry tables once they are read,
+    // and stays at the run if a table is missing.
+    CP::TValidityRange validity;
+    validity.Reset(context);
+
     // Get the channel table.
     CP::TResultSetHandle<CP::TTPC_Wire_Channel_Table> chanTable(context);
     Int_t numChannels(chanTable.GetNumRows());
@@ -153,7 +221,19 @@ void CP::TChannelInfo::SetContext(const CP::TEventContext& context) {
         if (numGeometries == 0) {
             CaptError("Missing geometry table for " << context);
         }
-        return;
+        // Only the CAPTCHANNELMAP override is available, so use it
+        // directly.
+        numChannels = 0;
+        numGeometries = 0;
+        channelMap->UseRecords(fOverride.GetRecords(),
+                               fOverride.GetRecordCount());
+    }
+    else {
+        validity.Restrict(chanTable.GetValidityRec());
+        validity.Restrict(geomTable.GetValidityRec());
+        // The database values replace the CAPTCHANNELMAP override.
+        channelMap->AddRecords(fOverride.GetRecords(),
+                               fOverride.GetRecordCount());
     }
 
     for (int i = 0; i<numChannels; ++i) {
@@ -168,22 +248,22 @@ void CP::TChannelInfo::SetContext(const CP::TEventContext& context) {
         int mb = chanRow->GetMotherBoard();
         int asic = chanRow->GetASIC();
         int asicChan = chanRow->GetASICChannel();
-        fChannelToASICMap[chanId] = mb*1000*1000 + asic*1000 + asicChan;
 
-        if (wire <= 0) continue;
-        fChannelToWireMap[chanId] = wire;
-        fWireToChannelMap[wire] = chanId;
+        if (wire <= 0) {
+            channelMap->AddChannel(chanId, CP::TGeometryId(), -1,
+                                  mb, asic, asicChan);
+            continue;
+        }
 
+        CP::TGeometryId geomId;
         const CP::TTPC_Wire_Geometry_Table* geomRow 
             = geomTable.GetRowByIndex(wire);
-        if (!geomRow) {
+        if (geomRow) geomId = geomRow->GetGeometryId();
+        else {
             CaptError("Missing geometry row " << chanId
                       << " --> " << wire );
-            continue;
         }
-        CP::TGeometryId geomId =  geomRow->GetGeometryId();
-        fChannelMap[chanId] = geomId;
-        fGeometryMap[geomId] = chanId;
+        channelMap->AddChannel(chanId, geomId, wire, mb, asic, asicChan);
     }
 
     for (int i = 0; i<numGeometries; ++i) {
@@ -196,424 +276,66 @@ void CP::TChannelInfo::SetContext(const CP::TEventContext& context) {
         CP::TGeometryId geomId =  geomRow->GetGeometryId();
         int wire = geomRow->GetWire();
         if (wire < 0) continue;
-        fGeometryToWireMap[geomId] = wire;
-        fWireToGeometryMap[wire] = geomId;
+        channelMap->AddWire(geomId, wire);
     }
 
+    channelMap->SetValidity(validity);
+    channelMap->Build();
+    return channelMap;
 }
 
 const CP::TEventContext& CP::TChannelInfo::GetContext() const {
-    if (fContext.IsValid()) return fContext;
+    const CP::TChannelMap& map = CurrentMap();
+    if (map.GetContext().IsValid()) return map.GetContext();
     CaptError("Event context must be set before using TChannelInfo.");
-    return fContext;
+    return map.GetContext();
 }
 
 CP::TChannelId CP::TChannelInfo::GetChannel(CP::TGeometryId gid, int index) {
-    // At the moment, index is always zero.
-    if (index != 0) return CP::TChannelId();
-
-    // Make sure that the identifier is valid.
-    if (!gid.IsValid()) {
-        CaptError("Invalid geometry id cannot be translated to a channel");
-        return CP::TChannelId();
-    }
-
-    // Make sure that we know what the current context is.  The channel to
-    // geometry mapping changes with time.
-    if (!GetContext().IsValid()) {
-        CaptError("Need valid event context to translate geometry to channel: "
-                  << GetContext());
-        return CP::TChannelId();
-    }
-
-    // The current context is for the MC, so the channel can be generated
-    // algorithmically.
-    if (GetContext().IsMC()) {
-        if (CP::GeomId::Captain::IsWire(gid)) {
-            return CP::TMCChannelId(
-                0,
-                CP::GeomId::Captain::GetWirePlane(gid),
-                CP::GeomId::Captain::GetWireNumber(gid));
-        }
-        else if (CP::GeomId::Captain::IsPhotosensor(gid)) {
-            return CP::TMCChannelId(
-                1, 0,
-                CP::GeomId::Captain::GetPhotosensor(gid));
-        }
-        return  CP::TChannelId();
-    }
-    
-    // The context is valid, and not for the MC, so it should be for the
-    // detector.  This shouldn't never happen, but it might.
-#ifdef CHECK_DETECTOR_CONTEXT
-    if (!GetContext().IsDetector()) {
-        CaptError("Channel requested for invalid event context");
-        return CP::TChannelId();
-    }
-#endif
-
-    std::map<CP::TGeometryId,CP::TChannelId>::iterator geometryEntry
-        = fGeometryMap.find(gid);
-
-    if (geometryEntry == fGeometryMap.end()) {
-        CaptWarn("Channel for object not found: " << gid);
-        return CP::TChannelId();
-    }
-        
-    return geometryEntry->second;
+    return CurrentMap().GetChannel(gid,index);
 }
 
 CP::TChannelId CP::TChannelInfo::GetChannel(int wirenumber, int index) {
-    // At the moment, index is always zero.
-    if (index != 0) return CP::TChannelId();
-    
-    // Make sure that the identifier is valid.
-    if (wirenumber == -1) {
-        CaptError("Invalid channel id can not be translated to a wire number");
-        return CP::TChannelId();
-    }
-    
-    // Make sure that we know what the current context is.  The channel to
-    // geometry mapping changes with time.
-    if (!GetContext().IsValid()) {
-        CaptError("Need valid event context to translate"
-                  << " channel id to wire number: "
-                  << GetContext());
-        return CP::TChannelId();
-    }
-    
-    // The current context is for the MC, so the channel can be generated
-    // algorithmically.
-    if (GetContext().IsMC()) {
-        // There isn't a defined wire number for a MC channel, so you can't
-        // convert from wire to channel.
-        return CP::TChannelId();
-    }
-    
-    // The context is valid, and not for the MC, so it should be for the
-    // detector.  This shouldn't never happen, but it might.
-#ifdef CHECK_DETECTOR_CONTEXT
-    if (!GetContext().IsDetector()) {
-        CaptError("Channel requested for invalid event context");
-        return CP::TChannelId();
-    }
-#endif
-
-    std::map<int,CP::TChannelId>::iterator channelEntry
-        = fWireToChannelMap.find(wirenumber);
-    if (channelEntry == fWireToChannelMap.end()) {
-        CaptWarn("Channel for object not found: " << wirenumber);
-        return CP::TChannelId();
-    }
-        
-    return channelEntry->second;
+    return CurrentMap().GetChannel(wirenumber,index);
 }
 
 int CP::TChannelInfo::GetChannelCount(CP::TGeometryId id) {
-    if (!id.IsValid()) return 0;
-    return 1;
+    return CurrentMap().GetChannelCount(id);
 }
 
 CP::TGeometryId CP::TChannelInfo::GetGeometry(CP::TChannelId cid) {
-    // Make sure that we have an event context since the channel to geometry
-    // mapping changes with time.
-    if (!GetContext().IsValid()) {
-        CaptWarn("Need valid event context to translate channel to geometry");
-        return CP::TGeometryId();
-    }
-
-    // Make sure this is a valid channel and flag an error if not.
-    if (!cid.IsValid()) {
-        CaptError("Invalid channel cannot be translated to geometry");
-        return CP::TGeometryId();
-    }
-
-    // The current context is for the MC, so the channel can be generated
-    // algorithmically.
-    if (cid.IsMCChannel()) {
-        CP::TMCChannelId id(cid);
-        if (id.GetType() == 0) {
-            // This is a wire channel.
-            return CP::GeomId::Captain::Wire(id.GetSequence(),id.GetNumber());
-        }
-        else if (id.GetType() == 1) {
-            // This is a light sensor.
-            return CP::GeomId::Captain::Photosensor(id.GetNumber());
-        }
-        return  CP::TGeometryId();
-    }
-    
-    // The context is valid, and not for the MC, so it should be for the
-    // detector.  This shouldn't never happen, but it might.
-#ifdef CHECK_DETECTOR_CONTEXT
-    if (!GetContext().IsDetector()) {
-        CaptWarn("Channel requested for invalid event context");
-        return CP::TGeometryId();
-    }
-#endif
-
-    std::map<CP::TChannelId, CP::TGeometryId>::iterator channelEntry
-        = fChannelMap.find(cid);
-
-    if (channelEntry == fChannelMap.end()) {
-        CaptWarn("Geometry for channel is not found: " << cid);
-        return CP::TGeometryId();
-    }
-        
-    return channelEntry->second;
+    return CurrentMap().GetGeometry(cid);
 }
 
 CP::TGeometryId CP::TChannelInfo::GetGeometry(int wirenumber) {
-    // Make sure that the identifier is valid.
-    if (wirenumber == -1) {
-        CaptError("Invalid wire number cannot be translated to a geometry");
-        return CP::TGeometryId();
-    }
-    
-    // Make sure that we know what the current context is.  The channel to
-    // geometry mapping changes with time.
-    if (!GetContext().IsValid()) {
-        CaptError("Invalid event context cannot be translated to geometry id: "
-                  << GetContext());
-        return CP::TGeometryId();
-    }
-    
-    // The current context is for the MC, so the channel can be generated
-    // algorithmically.
-    if (GetContext().IsMC()) {
-        // There isn't a defined wire number for a MC channel.  The MC wires
-        // are defined by the geometry position, not the position around the
-        // TPC frame.
-        return CP::TGeometryId();
-    }
-    
-    // The context is valid, and not for the MC, so it should be for the
-    // detector.  This shouldn't never happen, but it might.
-#ifdef CHECK_DETECTOR_CONTEXT
-    if (!GetContext().IsDetector()) {
-        CaptError("Channel requested for invalid event context");
-        return CP::TGeometryId();
-    }
-#endif
-
-    std::map<int,CP::TGeometryId>::iterator geometryEntry
-        = fWireToGeometryMap.find(wirenumber);
-    if (geometryEntry == fWireToGeometryMap.end()) {
-        CaptWarn("Geometry for object not found: " << wirenumber);
-        return CP::TGeometryId();
-    }
-        
-    return geometryEntry->second;
+    return CurrentMap().GetGeometry(wirenumber);
 }
 
 int CP::TChannelInfo::GetGeometryCount(CP::TChannelId id) {
-    if (!id.IsValid()) return 0;
-    return 1;
+    return CurrentMap().GetGeometryCount(id);
 }
 
 int CP::TChannelInfo::GetWireNumber(CP::TChannelId cid) {
-    // Make sure that the identifier is valid.
-    if (!cid.IsValid()) {
-        CaptError("Invalid channel id can not be translated to a wire number");
-        return -1;
-    }
-    
-    // Make sure that we know what the current context is.  The channel to
-    // geometry mapping changes with time.
-    if (!GetContext().IsValid()) {
-        CaptError("Need valid event context to translate"
-                  << " channel id to wire number: "
-                  << GetContext());
-        return -1;
-    }
-    
-    // The current context is for the MC, so the channel can be generated
-    // algorithmically.
-    if (cid.IsMCChannel()) {
-#ifdef CHECK_MC_CONTEXT
-        if (GetContext().IsMC()) {
-            CaptError("Channel requested for invalid event context");
-            return -1;
-        }
-#endif
-        // There isn't a defined wire number for a MC channel.  The MC wires
-        // are defined by the geometry position, not the position around the
-        // TPC frame.
-        return -1;
-    }
-    
-    // The context is valid, and not for the MC, so it should be for the
-    // detector.  This shouldn't never happen, but it might.
-#ifdef CHECK_DETECTOR_CONTEXT
-    if (GetContext().IsDetector()) {
-        CaptError("Channel requested for invalid event context");
-        return -1;
-    }
-#endif
-
-    std::map<CP::TChannelId, int>::iterator wireEntry
-        = fChannelToWireMap.find(cid);
-    if (wireEntry == fChannelToWireMap.end()) {
-        CaptWarn("Channel for object not found: " << cid);
-        return -1;
-    }
-        
-    return wireEntry->second;
+    return CurrentMap().GetWireNumber(cid);
 }
 
 int CP::TChannelInfo::GetWireNumber(CP::TGeometryId gid) {
-    // Make sure that the identifier is valid.
-    if (!gid.IsValid()) {
-        CaptError("Invalid geometry id can not be translated to a wire number");
-        return -1;
-    }
-    
-    // Make sure that we know what the current context is.  The channel to
-    // geometry mapping changes with time.
-    if (!GetContext().IsValid()) {
-        CaptError("Need valid event context to translate"
-                  << " geometry id to wire number: "
-                  << GetContext());
-        return -1;
-    }
-    
-    // The current context is for the MC, so the channel can be generated
-    // algorithmically.
-    if (GetContext().IsMC()) {
-        // There isn't a defined wire number for a MC channel.  The MC wires
-        // are defined by the geometry position, not the position around the
-        // TPC frame.
-        return -1;
-    }
-    
-    // The context is valid, and not for the MC, so it should be for the
-    // detector.  This shouldn't never happen, but it might.
-#ifdef CHECK_DETECTOR_CONTEXT
-    if (!GetContext().IsDetector()) {
-        CaptError("Channel requested for invalid event context");
-        return -1;
-    }
-#endif
-
-    std::map<CP::TGeometryId, int>::iterator wireEntry
-        = fGeometryToWireMap.find(gid);
-    if (wireEntry == fGeometryToWireMap.end()) {
-        CaptWarn("Geometry for object not found: " << gid);
-        return -1;
-    }
-        
-    return wireEntry->second;
+    return CurrentMap().GetWireNumber(gid);
 }
 
-
 int CP::TChannelInfo::GetMotherboard(CP::TChannelId cid) {
-    // Make sure that we have an event context since the channel to geometry
-    // mapping changes with time.
-    if (!GetContext().IsValid()) {
-        CaptWarn("Need valid event context to translate channel to geometry");
-        return -1;
-    }
-
-    // Make sure this is a valid channel and flag an error if not.
-    if (!cid.IsValid()) {
-        CaptError("Invalid channel cannot be translated to geometry");
-        return -1;
-    }
-
-    // The current context is for the MC, so the channel can be generated
-    // algorithmically.
-    if (cid.IsMCChannel()) {
-        return -1;
-    }
-    
-    // The context is valid, and not for the MC, so it should be for the
-    // detector.  This shouldn't never happen, but it might.
-    if (!GetContext().IsDetector()) {
-        CaptWarn("Channel requested for invalid event context");
-        return -1;
-    }
-
-    std::map<CP::TChannelId, int>::iterator channelEntry
-        = fChannelToASICMap.find(cid);
-
-    if (channelEntry == fChannelToASICMap.end()) {
-        return -1;
-    }
-        
-    return channelEntry->second/1000000;
+    return CurrentMap().GetMotherboard(cid);
 }
 
 int CP::TChannelInfo::GetASIC(CP::TChannelId cid) {
-    // Make sure that we have an event context since the channel to geometry
-    // mapping changes with time.
-    if (!GetContext().IsValid()) {
-        CaptWarn("Need valid event context to translate channel to geometry");
-        return -1;
-    }
-
-    // Make sure this is a valid channel and flag an error if not.
-    if (!cid.IsValid()) {
-        CaptError("Invalid channel cannot be translated to geometry");
-        return -1;
-    }
-
-    // The current context is for the MC, so the channel can be generated
-    // algorithmically.
-    if (cid.IsMCChannel()) {
-        return -1;
-    }
-    
-    // The context is valid, and not for the MC, so it should be for the
-    // detector.  This shouldn't never happen, but it might.
-    if (!GetContext().IsDetector()) {
-        CaptWarn("Channel requested for invalid event context");
-        return -1;
-    }
-
-    std::map<CP::TChannelId, int>::iterator channelEntry
-        = fChannelToASICMap.find(cid);
-
-    if (channelEntry == fChannelToASICMap.end()) {
-        return -1;
-    }
-        
-    return (channelEntry->second/1000) % 1000;
+    return CurrentMap().GetASIC(cid);
 }
 
 int CP::TChannelInfo::GetASICChannel(CP::TChannelId cid) {
-    // Make sure that we have an event context since the channel to geometry
-    // mapping changes with time.
-    if (!GetContext().IsValid()) {
-        CaptWarn("Need valid event context to translate channel to geometry");
-        return -1;
-    }
-
-    // Make sure this is a valid channel and flag an error if not.
-    if (!cid.IsValid()) {
-        CaptError("Invalid channel cannot be translated to geometry");
-        return -1;
-    }
-
-    // The current context is for the MC, so the channel can be generated
-    // algorithmically.
-    if (cid.IsMCChannel()) {
-        return -1;
-    }
-    
-    // The context is valid, and not for the MC, so it should be for the
-    // detector.  This shouldn't never happen, but it might.
-    if (!GetContext().IsDetector()) {
-        CaptWarn("Channel requested for invalid event context");
-        return -1;
-    }
-
-    std::map<CP::TChannelId, int>::iterator channelEntry
-        = fChannelToASICMap.find(cid);
-
-    if (channelEntry == fChannelToASICMap.end()) {
-        return -1;
-    }
-        
-    return channelEntry->second % 1000;
+    return CurrentMap().GetASICChannel(cid);
 }
 
+bool CP::TChannelInfo::GetChannelRecord(CP::TChannelId cid,
+                                        CP::TChannelMap::Record& record) {
+    return CurrentMap().GetChannelRecord(cid,record);
+}
@@ -6,7 +6,14 @@
 #include <TGeometryId.hxx>
 #include <method_deprecated.hxx>
 
-#include <map>
+#include "TChannelMap.hxx"
+#include "TChannelMapFile.hxx"
+#include "TWireAdjacency.hxx"
+
+#include <list>
+#include <memory>
+#include <atomic>
+#include <mutex>
 
 namespace CP {
     class TChannelInfo;
@@ -17,6 +24,13 @@ namespace CP {
 /// provides a two way map.  To be used, the event context needs to have been
 /// set using the SetContext method.  Generally, SetContext() should be called
 /// when a new event is handled.
+///
+/// The lookups can be done from any thread.  The mapping for the current
+/// context is published as an immutable CP::TChannelMap, and each thread
+/// keeps a reference to the most recently published map.  A lookup only
+/// needs to compare a generation counter, so readers don't lock, and a
+/// context change never modifies a map that another thread is reading.
+/// Calls to SetContext() are serialized.
 class CP::TChannelInfo {
 public:
     /// Return a reference to the singleton.
@@ -24,14 +38,19 @@ public:
 
     /// Set the event context to be used when mapping identifiers.  This
     /// should be set before accessing the identifiers.  This may trigger a
-    /// database access if the context is changing.  Explicitly setting the
-    /// context is required since this allows lookups even when an event is
-    /// not available.
+    /// database access if the context is outside of the validity range of
+    /// the currently loaded mapping.  Explicitly setting the context is
+    /// required since this allows lookups even when an event is not
+    /// available.
     void SetContext(const CP::TEventContext& context);
 
-    /// Get the event context being used for mapping identifiers.  If the
-    /// context has not been set explicitly, then it will try the value for
-    /// the current event.
+    /// Get the event context being used for mapping identifiers.  This is
+    /// the context that the map currently used by the calling thread was
+    /// loaded for, so it has the same validity range as the most recent
+    /// call to SetContext() (for an MC context, it is the first MC context
+    /// that was set).  It is safe to call while another thread is calling
+    /// SetContext(), and the reference stays valid until the next lookup
+    /// on the calling thread after the context changes.
     const CP::TEventContext& GetContext() const;
 
     /// Map a geometry identifier into a channel identifier.  This takes an
@@ -85,6 +104,133 @@ public:
     /// Get the channel on the asic associated with the channel id.
     int GetASICChannel(CP::TChannelId id);
 
+    /// Get everything known about a channel with a single lookup.  This
+    /// fills the record with the geometry, the wire number and the cold
+    /// electronics (motherboard, ASIC, and ASIC channel) for the channel.
+    /// The fields that are not known for the channel are set to -1 (or an
+    /// invalid identifier).  This returns false if the channel can't be
+    /// found in the current mapping.  For MC channels, the geometry is
+    /// generated algorithmically and the other fields are -1.
+    bool GetChannelRecord(CP::TChannelId cid,
+                          CP::TChannelMap::Record& record);
+
+    /// \name Batch lookups
+    /// Translate a contiguous array of "n" identifiers for a whole event in
+    /// one call.  The context is checked once per batch, and entries that
+    /// can't be translated are flagged in the optional "missing" mask
+    /// instead of producing a warning.  The return value is the number of
+    /// missing entries.  See CP::TChannelMap for the details.
+    /// @{
+    int GetGeometry(const CP::TChannelId* ids, int n,
+                    CP::TGeometryId* geomIds,
+                    std::vector<bool>* missing = NULL) {
+        return CurrentMap().GetGeometry(ids,n,geomIds,missing);
+    }
+    int GetChannel(const CP::TGeometryId* ids, int n,
+                   CP::TChannelId* chanIds,
+                   std::vector<bool>* missing = NULL) {
+        return CurrentMap().GetChannel(ids,n,chanIds,missing);
+    }
+    int GetWireNumber(const CP::TChannelId* ids, int n,
+                      int* wires,
+                      std::vector<bool>* missing = NULL) {
+        return CurrentMap().GetWireNumber(ids,n,wires,missing);
+    }
+    int GetMotherboard(const CP::TChannelId* ids, int n,
+                       int* motherboards,
+                       std::vector<bool>* missing = NULL) {
+        return CurrentMap().GetMotherboard(ids,n,motherboards,missing);
+    }
+    int GetASIC(const CP::TChannelId* ids, int n,
+                int* asics,
+                std::vector<bool>* missing = NULL) {
+        return CurrentMap().GetASIC(ids,n,asics,missing);
+    }
+    int GetASICChannel(const CP::TChannelId* ids, int n,
+                       int* asicChannels,
+                       std::vector<bool>* missing = NULL) {
+        return CurrentMap().GetASICChannel(ids,n,asicChannels,missing);
+    }
+    int GetChannelRecord(const CP::TChannelId* ids, int n,
+                         CP::TChannelMap::Record* records,
+                         std::vector<bool>* missing = NULL) {
+        return CurrentMap().GetChannelRecord(ids,n,records,missing);
+    }
+    /// @}
+
+    /// Add a channel map that was built outside of the database (e.g. for
+    /// testing) to the cache.  It is used when SetContext() is called for a
+    /// context inside of the validity range of the map.  The map is the most
+    /// recently used, so it may push older maps out of the cache.
+    void AddChannelMap(const std::shared_ptr<const CP::TChannelMap>& map);
+
+    /// Get the index of the channels in each cold motherboard, cold ASIC,
+    /// crate, or FEM for the current context.  The index is built once for
+    /// each channel map, and lists the channels in each group as a
+    /// contiguous array of record positions (see CP::TChannelMap::Groups).
+    /// The index belongs to the map that the calling thread is using.  After
+    /// the context changes (in any thread), the next lookup from this thread
+    /// switches to the new map, and the reference dangles if the old map
+    /// has been dropped from the cache.  Code that keeps the index, or that
+    /// runs while another thread may change the context, should keep the
+    /// map from GetChannelMap() and call CP::TChannelMap::GetGroups() on it.
+    const CP::TChannelMap::Groups& GetGroups(
+        CP::TChannelMap::GroupType type) {
+        return CurrentMap().GetGroups(type);
+    }
+
+    /// Get the electronics group for a channel in the current context.  See
+    /// CP::TChannelMap::GetGroup().
+    int GetGroup(CP::TChannelMap::GroupType type, CP::TChannelId cid) {
+        return CurrentMap().GetGroup(type, cid);
+    }
+
+    /// Get the channel map for an event context without changing the
+    /// context used by this class.  The map is immutable, so a thread can
+    /// keep it as a handle for the context, and use it for lookups without
+    /// touching any shared state.  This is the way to translate identifiers
+    /// when events from different contexts are handled by different threads.
+    /// This may trigger a database access if the map isn't cached.  The
+    /// returned map is never NULL, but will be empty if the context is
+    /// invalid.
+    std::shared_ptr<const CP::TChannelMap> GetChannelMap(
+        const CP::TEventContext& context);
+
+    /// Get the channels for the wires in each plane, ordered by the wire
+    /// number in the plane, for an event context.  This includes whether
+    /// each wire is good for the run of the context, so the neighbours of a
+    /// wire (and whether they are good) are found with a pointer offset.
+    /// See CP::TWireAdjacency.  The adjacency is built once for each
+    /// channel map and run, and the most recent one is kept.  The returned
+    /// adjacency is never NULL.
+    std::shared_ptr<const CP::TWireAdjacency> GetWireAdjacency(
+        const CP::TEventContext& context);
+
+    /// Set the maximum number of channel maps that are cached.  The maps for
+    /// recently used event contexts are kept, so switching back to a recent
+    /// context (e.g. when events from different runs are interleaved) does
+    /// not require a database access.  The capacity includes the map for the
+    /// current context, so it is at least one.  The default can be set with
+    /// the captChanInfo.cache.capacity parameter.
+    void SetCacheCapacity(int capacity);
+
+    /// Get the maximum number of channel maps that are cached.
+    int GetCacheCapacity() const {return fCacheCapacity;}
+
+    /// Get the number of channel maps that are currently cached.
+    int GetCacheSize() const;
+
+    /// Get the approximate memory used by the cached channel maps in bytes.
+    std::size_t GetCacheMemoryUsage() const;
+
+    /// Get the number of context changes that were satisfied by a cached
+    /// channel map.
+    int GetCacheHits() const {return fCacheHits;}
+
+    /// Get the number of context changes that required the channel map to be
+    /// loaded from the database.
+    int GetCacheMisses() const {return fCacheMisses;}
+
     /// DEPRECATED: Use GetWireNumber.
     int GetWireFromChannel(CP::TChannelId cid) METHOD_DEPRECATED {
         return GetWireNumber(cid);
@@ -106,29 +252,77 @@ private:
     TChannelInfo& operator=(const TChannelInfo&);
     /// @}
 
+    /// Get the most recently published map for the calling thread.  This
+    /// only touches the shared map when a new one has been published.
+    const CP::TChannelMap& CurrentMap() const;
+
+    /// Publish a new map so that it will be used for lookups by all threads.
+    void Publish(const std::shared_ptr<const CP::TChannelMap>& map);
+
+    /// Find the map for an event context.  This checks the current map, and
+    /// then the cache, and finally loads the map from the database.  This
+    /// must be called while holding fMutex.
+    std::shared_ptr<const CP::TChannelMap> FindMap(
+        const CP::TEventContext& context);
+
+    /// Load the mapping for a new event context from the database.  The map
+    /// is built from scratch (starting from the CAPTCHANNELMAP override), so
+    /// entries from a previous context can't survive.
+    std::shared_ptr<const CP::TChannelMap> LoadMap(
+        const CP::TEventContext& context);
+
     /// The event context to be used to map identifiers
     CP::TEventContext fContext;
 
-    /// The map from channel id to geometry id.
-    std::map<CP::TChannelId,CP::TGeometryId> fChannelMap;
+    /// The channel map file specified by the CAPTCHANNELMAP environment
+    /// variable.  This is used as the starting point whenever the maps are
+    /// loaded, and is used directly if the database tables are missing.
+    CP::TChannelMapFile fOverride;
 
-    /// The map from geometry id to channel id.
-    std::map<CP::TGeometryId,CP::TChannelId> fGeometryMap;
-    
-    /// The map from channel id to wire number
-    std::map<CP::TChannelId, int> fChannelToWireMap;
-    
-    /// The map from wire number to channel id
-    std::map<int, CP::TChannelId> fWireToChannelMap;
+    /// The channel mapping for the current context.  This is never NULL.
+    /// It is only used by SetContext() (while holding fMutex), and readers
+    /// get the published map through fPublished.
+    std::shared_ptr<const CP::TChannelMap> fMap;
 
-    /// The map from wire number to geometry id.
-    std::map<int, CP::TGeometryId> fWireToGeometryMap;
-    
-    /// The map from geometry id to wire number.
-    std::map<CP::TGeometryId, int> fGeometryToWireMap;
+    /// The map published for the readers.  This is only accessed using the
+    /// std::atomic_load and std::atomic_store functions.
+    std::shared_ptr<const CP::TChannelMap> fPublished;
+
+    /// Incremented every time a new map is published.  Readers compare this
+    /// to the generation of their thread local copy of the map.
+    std::atomic<unsigned int> fGeneration;
+
+    /// The map used when the context is invalid.
+    std::shared_ptr<const CP::TChannelMap> fEmptyMap;
+
+    /// The map used for MC contexts.  The MC mapping is done
+    /// algorithmically, so this doesn't have any channels.
+    std::shared_ptr<const CP::TChannelMap> fMCMap;
+
+    /// Serialize calls to SetContext(), GetChannelMap() and the cache
+    /// methods.
+    mutable std::mutex fMutex;
+
+    /// The most recently built wire adjacency, and the map and run used to
+    /// build it.
+    /// @{
+    std::shared_ptr<const CP::TWireAdjacency> fAdjacency;
+    std::shared_ptr<const CP::TChannelMap> fAdjacencyMap;
+    int fAdjacencyRun;
+    /// @}
+
+    /// The most recently used channel maps.  The front of the list is the
+    /// most recently used.
+    std::list< std::shared_ptr<const CP::TChannelMap> > fCache;
+
+    /// The maximum number of maps in the cache.  This is changed while
+    /// holding fMutex, but can be read without it.
+    std::atomic<int> fCacheCapacity;
+
+    /// The number of context changes that found a map in the cache.
+    std::atomic<int> fCacheHits;
 
-    /// The map from channel id to asic channel.  The ASIC is encoded by
-    /// channel+1000*ASIC+1000*MB
-    std::map<CP::TChannelId, int> fChannelToASICMap;
+    /// The number of context changes that needed to load a map.
+    std::atomic<int> fCacheMisses;
 };
 #endif
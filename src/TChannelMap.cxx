@@ -0,0 +1,948 @@
+#include "TChannelMap.hxx"
+
+#include <TCaptLog.hxx>
+#include <CaptGeomId.hxx>
+#include <TChannelId.hxx>
+#include <TMCChannelId.hxx>
+#include <TTPCChannelId.hxx>
+#include <TGeometryId.hxx>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace {
+    // Order the records by the channel.
+    bool RecordChannelLess(const CP::TChannelMap::Record& lhs,
+                           const CP::TChannelMap::Record& rhs) {
+        return lhs.fChannel < rhs.fChannel;
+    }
+
+    // Set a record to the values for a channel that isn't in the map.
+    void ResetRecord(CP::TChannelMap::Record& record, CP::TChannelId cid) {
+        record.fChannel = cid.AsUInt();
+        record.fGeometry = CP::TGeometryId().AsInt();
+        record.fWire = -1;
+        record.fMotherboard = -1;
+        record.fASIC = -1;
+        record.fASICChannel = -1;
+        record.fSpare = 0;
+    }
+
+    // The number of channels handled in each block of a batch lookup.  The
+    // records for a block are found first, and then the output is filled
+    // from the records so the loops are short and branch free.
+    const int kBatchBlock = 64;
+
+    // Hint that an address is about to be read so that the memory accesses
+    // for a block of channels overlap.
+    inline void Prefetch(const void* address) {
+#if defined(__GNUC__)
+        __builtin_prefetch(address);
+#endif
+    }
+
+    // Generate the geometry for an MC channel.  This doesn't check the
+    // context, or if the channel is valid.
+    CP::TGeometryId MCGeometry(CP::TChannelId cid) {
+        CP::TMCChannelId id(cid);
+        if (id.GetType() == 0) {
+            // This is a wire channel.
+            return CP::GeomId::Captain::Wire(id.GetSequence(),id.GetNumber());
+        }
+        else if (id.GetType() == 1) {
+            // This is a light sensor.
+            return CP::GeomId::Captain::Photosensor(id.GetNumber());
+        }
+        return  CP::TGeometryId();
+    }
+
+    // Generate the MC channel for a geometry identifier.  This doesn't check
+    // the context, or if the identifier is valid.
+    CP::TChannelId MCChannel(CP::TGeometryId gid) {
+        if (CP::GeomId::Captain::IsWire(gid)) {
+            return CP::TMCChannelId(
+                0,
+                CP::GeomId::Captain::GetWirePlane(gid),
+                CP::GeomId::Captain::GetWireNumber(gid));
+        }
+        else if (CP::GeomId::Captain::IsPhotosensor(gid)) {
+            return CP::TMCChannelId(
+                1, 0,
+                CP::GeomId::Captain::GetPhotosensor(gid));
+        }
+        return  CP::TChannelId();
+    }
+
+    // Do a batch lookup of a field in the channel records.  The extract
+    // function copies the field from a record and returns false if the
+    // field isn't set.  This returns the number of missing entries.
+    template <typename Value, typename Extract>
+    int BatchLookup(const CP::TChannelMap& map,
+                    const CP::TChannelId* ids, int n,
+                    Value* values, const Value& invalid,
+                    std::vector<bool>* missing,
+                    Extract extract) {
+        const CP::TChannelMap::Record* records[kBatchBlock];
+        int count = 0;
+        for (int first = 0; first < n; first += kBatchBlock) {
+            int size = std::min(kBatchBlock, n - first);
+            map.FindChannel(ids+first, size, records);
+            for (int i = 0; i < size; ++i) {
+                bool found
+                    = records[i] && extract(*records[i], values[first+i]);
+                if (!found) {
+                    values[first+i] = invalid;
+                    ++count;
+                }
+                if (missing) (*missing)[first+i] = !found;
+            }
+        }
+        return count;
+    }
+}
+
+CP::TChannelMap::TChannelMap()
+    : fRecordData(NULL), fRecordCount(0), fExternal(false) {}
+
+void CP::TChannelMap::Clear() {
+    fContext = CP::TEventContext();
+    fValidity.Invalidate();
+    fRecords.clear();
+    fRecordData = NULL;
+    fRecordCount = 0;
+    fExternal = false;
+    fIndex.Clear();
+    fSlotRecord.clear();
+    fWireRecord.clear();
+    fWireGeometry.clear();
+    for (int i=0; i<3; ++i) {
+        fPlaneRecord[i].clear();
+        fPlaneWire[i].clear();
+    }
+    for (int i=0; i<kGroupTypes; ++i) fGroups[i] = Groups();
+}
+
+void CP::TChannelMap::AddChannel(CP::TChannelId cid,
+                                 CP::TGeometryId gid,
+                                 int wire,
+                                 int motherboard,
+                                 int asic,
+                                 int asicChannel) {
+    Record record;
+    record.fChannel = cid.AsUInt();
+    record.fGeometry = gid.AsInt();
+    record.fWire = wire;
+    record.fMotherboard = motherboard;
+    record.fASIC = asic;
+    record.fASICChannel = asicChannel;
+    record.fSpare = 0;
+    fRecords.push_back(record);
+}
+
+void CP::TChannelMap::AddRecords(const Record* records, int n) {
+    if (!records || n < 1) return;
+    fRecords.insert(fRecords.end(), records, records+n);
+}
+
+void CP::TChannelMap::UseRecords(const Record* records, int n) {
+    fRecords.clear();
+    fRecordData = records;
+    fRecordCount = records? n: 0;
+    fExternal = true;
+}
+
+void CP::TChannelMap::AddWire(CP::TGeometryId gid, int wire) {
+    if (wire < 0) return;
+    if ((int) fWireGeometry.size() <= wire) fWireGeometry.resize(wire+1);
+    fWireGeometry[wire] = gid;
+    int plane;
+    int planeWire;
+    if (!FindPlaneWire(gid,plane,planeWire)) return;
+    if ((int) fPlaneWire[plane].size() <= planeWire) {
+        fPlaneWire[plane].resize(planeWire+1,-1);
+    }
+    fPlaneWire[plane][planeWire] = wire;
+}
+
+void CP::TChannelMap::Build() {
+    // Sort the records and merge any duplicate channels.  Later values
+    // replace earlier ones, but only if they are valid.  External records
+    // are used directly (they are already sorted) unless channels have been
+    // added after them.
+    if (fExternal && !fRecords.empty()) {
+        fRecords.insert(fRecords.begin(), fRecordData,
+                        fRecordData+fRecordCount);
+        fExternal = false;
+    }
+    if (!fExternal) MergeRecords();
+    BuildIndex();
+    BuildGroups();
+}
+
+void CP::TChannelMap::MergeRecords() {
+    std::stable_sort(fRecords.begin(), fRecords.end(), RecordChannelLess);
+    std::vector<Record> records;
+    records.reserve(fRecords.size());
+    for (std::vector<Record>::iterator r = fRecords.begin();
+         r != fRecords.end(); ++r) {
+        if (records.empty() || records.back().fChannel != r->fChannel) {
+            records.push_back(*r);
+            continue;
+        }
+        Record& last = records.back();
+        if (r->GetGeometryId().IsValid()) last.fGeometry = r->fGeometry;
+        if (r->fWire >= 0) last.fWire = r->fWire;
+        if (r->fMotherboard >= 0) last.fMotherboard = r->fMotherboard;
+        if (r->fASIC >= 0) last.fASIC = r->fASIC;
+        if (r->fASICChannel >= 0) last.fASICChannel = r->fASICChannel;
+    }
+    fRecords.swap(records);
+    fRecordCount = fRecords.size();
+    fRecordData = fRecords.empty()? NULL: &fRecords[0];
+}
+
+void CP::TChannelMap::BuildIndex() {
+    // Build the dense channel index.
+    fIndex.Clear();
+    for (int i = 0; i < fRecordCount; ++i) {
+        fIndex.Include(fRecordData[i].GetChannelId());
+    }
+
+    fSlotRecord.assign(fIndex.GetSize(),-1);
+    fWireRecord.clear();
+    for (int i=0; i<3; ++i) fPlaneRecord[i].clear();
+
+    for (int i = 0; i < fRecordCount; ++i) {
+        const Record& record = fRecordData[i];
+        int slot = fIndex.GetSlot(record.GetChannelId());
+        if (slot >= 0) fSlotRecord[slot] = i;
+        if (record.fWire >= 0) {
+            if ((int) fWireRecord.size() <= record.fWire) {
+                fWireRecord.resize(record.fWire+1,-1);
+            }
+            fWireRecord[record.fWire] = i;
+        }
+        int plane;
+        int planeWire;
+        if (!FindPlaneWire(record.GetGeometryId(),plane,planeWire)) continue;
+        if ((int) fPlaneRecord[plane].size() <= planeWire) {
+            fPlaneRecord[plane].resize(planeWire+1,-1);
+        }
+        fPlaneRecord[plane][planeWire] = i;
+    }
+}
+
+void CP::TChannelMap::BuildGroups() {
+    // Find the key of every record for each type of group.  Records that
+    // aren't in a group have a negative key.
+    std::vector< std::pair<int,int> > keys[kGroupTypes];
+    for (int t = 0; t < kGroupTypes; ++t) {
+        keys[t].assign(fRecordCount, std::make_pair(-1,-1));
+    }
+    for (int i = 0; i < fRecordCount; ++i) {
+        const Record& record = fRecordData[i];
+        if (record.fMotherboard >= 0) {
+            keys[kMotherboardGroup][i]
+                = std::make_pair((int) record.fMotherboard, -1);
+            if (record.fASIC >= 0) {
+                keys[kASICGroup][i]
+                    = std::make_pair((int) record.fMotherboard,
+                                     (int) record.fASIC);
+            }
+        }
+        CP::TChannelId cid = record.GetChannelId();
+        if (!cid.IsValid() || cid.IsMCChannel()) continue;
+        CP::TTPCChannelId tpcId(cid);
+        if (!tpcId.IsValid()) continue;
+        keys[kCrateGroup][i] = std::make_pair(tpcId.GetCrate(), -1);
+        keys[kFEMGroup][i] = std::make_pair(tpcId.GetCrate(), tpcId.GetFEM());
+    }
+
+    // Fill the index with a counting sort, so the records stay in channel
+    // order within each group.
+    for (int t = 0; t < kGroupTypes; ++t) {
+        Groups& groups = fGroups[t];
+        std::map<std::pair<int,int>, int> keyGroup;
+        for (int i = 0; i < fRecordCount; ++i) {
+            if (keys[t][i].first < 0) continue;
+            keyGroup.insert(std::make_pair(keys[t][i], 0));
+        }
+        groups.fKey.clear();
+        for (std::map<std::pair<int,int>, int>::iterator k = keyGroup.begin();
+             k != keyGroup.end(); ++k) {
+            k->second = groups.fKey.size();
+            groups.fKey.push_back(k->first);
+        }
+        groups.fGroup.assign(fRecordCount, -1);
+        groups.fOffset.assign(groups.fKey.size()+1, 0);
+        for (int i = 0; i < fRecordCount; ++i) {
+            if (keys[t][i].first < 0) continue;
+            int group = keyGroup[keys[t][i]];
+            groups.fGroup[i] = group;
+            ++groups.fOffset[group+1];
+        }
+        for (std::size_t g = 0; g < groups.fKey.size(); ++g) {
+            groups.fOffset[g+1] += groups.fOffset[g];
+        }
+        groups.fRecord.resize(groups.fOffset.back());
+        std::vector<int> next(groups.fOffset.begin(),
+                              groups.fOffset.end()-1);
+        for (int i = 0; i < fRecordCount; ++i) {
+            int group = groups.fGroup[i];
+            if (group < 0) continue;
+            groups.fRecord[next[group]++] = i;
+        }
+    }
+}
+
+const CP::TChannelMap::Record*
+CP::TChannelMap::FindGeometry(CP::TGeometryId gid) const {
+    int plane;
+    int wire;
+    if (!FindPlaneWire(gid,plane,wire)) return NULL;
+    if ((int) fPlaneRecord[plane].size() <= wire) return NULL;
+    int r = fPlaneRecord[plane][wire];
+    if (r < 0) return NULL;
+    return &fRecordData[r];
+}
+
+int CP::TChannelMap::GetGeometryWire(CP::TGeometryId gid) const {
+    int plane;
+    int wire;
+    if (!FindPlaneWire(gid,plane,wire)) return -1;
+    if ((int) fPlaneWire[plane].size() <= wire) return -1;
+    return fPlaneWire[plane][wire];
+}
+
+std::size_t CP::TChannelMap::GetMemoryUsage() const {
+    std::size_t size = sizeof(*this);
+    size += fRecords.capacity()*sizeof(Record);
+    size += fSlotRecord.capacity()*sizeof(int);
+    size += fWireRecord.capacity()*sizeof(int);
+    size += fWireGeometry.capacity()*sizeof(CP::TGeometryId);
+    for (int i=0; i<3; ++i) {
+        size += fPlaneRecord[i].capacity()*sizeof(int);
+        size += fPlaneWire[i].capacity()*sizeof(int);
+    }
+    for (int i=0; i<kGroupTypes; ++i) {
+        size += fGroups[i].fKey.capacity()*sizeof(std::pair<int,int>);
+        size += fGroups[i].fOffset.capacity()*sizeof(int);
+        size += fGroups[i].fRecord.capacity()*sizeof(int);
+        size += fGroups[i].fGroup.capacity()*sizeof(int);
+    }
+    return size;
+}
+
+bool CP::TChannelMap::FindPlaneWire(CP::TGeometryId id,
+                                    int& plane, int& wire) {
+    if (!id.IsValid()) return false;
+    if (!CP::GeomId::Captain::IsWire(id)) return false;
+    plane = CP::GeomId::Captain::GetWirePlane(id);
+    if (plane < 0 || 2 < plane) return false;
+    wire = CP::GeomId::Captain::GetWireNumber(id);
+    if (wire < 0) return false;
+    return true;
+}
+
+CP::TChannelId CP::TChannelMap::GetChannel(CP::TGeometryId gid,
+                                           int index) const {
+    // At the moment, index is always zero.
+    if (index != 0) return CP::TChannelId();
+
+    // Make sure that the identifier is valid.
+    if (!gid.IsValid()) {
+        CaptError("Invalid geometry id cannot be translated to a channel");
+        return CP::TChannelId();
+    }
+
+    // Make sure that we know what the current context is.  The channel to
+    // geometry mapping changes with time.
+    if (!GetContext().IsValid()) {
+        CaptError("Need valid event context to translate geometry to channel: "
+                  << GetContext());
+        return CP::TChannelId();
+    }
+
+    // The current context is for the MC, so the channel can be generated
+    // algorithmically.
+    if (GetContext().IsMC()) return MCChannel(gid);
+    
+    // The context is valid, and not for the MC, so it should be for the
+    // detector.  This shouldn't never happen, but it might.
+#ifdef CHECK_DETECTOR_CONTEXT
+    if (!GetContext().IsDetector()) {
+        CaptError("Channel requested for invalid event context");
+        return CP::TChannelId();
+    }
+#endif
+
+    const CP::TChannelMap::Record* record = FindGeometry(gid);
+    if (!record) {
+        CaptWarn("Channel for object not found: " << gid);
+        return CP::TChannelId();
+    }
+        
+    return record->GetChannelId();
+}
+
+CP::TChannelId CP::TChannelMap::GetChannel(int wirenumber, int index) const {
+    // At the moment, index is always zero.
+    if (index != 0) return CP::TChannelId();
+    
+    // Make sure that the identifier is valid.
+    if (wirenumber == -1) {
+        CaptError("Invalid channel id can not be translated to a wire number");
+        return CP::TChannelId();
+    }
+    
+    // Make sure that we know what the current context is.  The channel to
+    // geometry mapping changes with time.
+    if (!GetContext().IsValid()) {
+        CaptError("Need valid event context to translate"
+                  << " channel id to wire number: "
+                  << GetContext());
+        return CP::TChannelId();
+    }
+    
+    // The current context is for the MC, so the channel can be generated
+    // algorithmically.
+    if (GetContext().IsMC()) {
+        // There isn't a defined wire number for a MC channel, so you can't
+        // convert from wire to channel.
+        return CP::TChannelId();
+    }
+    
+    // The context is valid, and not for the MC, so it should be for the
+    // detector.  This shouldn't never happen, but it might.
+#ifdef CHECK_DETECTOR_CONTEXT
+    if (!GetContext().IsDetector()) {
+        CaptError("Channel requested for invalid event context");
+        return CP::TChannelId();
+    }
+#endif
+
+    const CP::TChannelMap::Record* record = FindWire(wirenumber);
+    if (!record) {
+        CaptWarn("Channel for object not found: " << wirenumber);
+        return CP::TChannelId();
+    }
+        
+    return record->GetChannelId();
+}
+
+int CP::TChannelMap::GetChannelCount(CP::TGeometryId id) const {
+    if (!id.IsValid()) return 0;
+    return 1;
+}
+
+CP::TGeometryId CP::TChannelMap::GetGeometry(CP::TChannelId cid) const {
+    // Make sure that we have an event context since the channel to geometry
+    // mapping changes with time.
+    if (!GetContext().IsValid()) {
+        CaptWarn("Need valid event context to translate channel to geometry");
+        return CP::TGeometryId();
+    }
+
+    // Make sure this is a valid channel and flag an error if not.
+    if (!cid.IsValid()) {
+        CaptError("Invalid channel cannot be translated to geometry");
+        return CP::TGeometryId();
+    }
+
+    // The current context is for the MC, so the channel can be generated
+    // algorithmically.
+    if (cid.IsMCChannel()) return MCGeometry(cid);
+    
+    // The context is valid, and not for the MC, so it should be for the
+    // detector.  This shouldn't never happen, but it might.
+#ifdef CHECK_DETECTOR_CONTEXT
+    if (!GetContext().IsDetector()) {
+        CaptWarn("Channel requested for invalid event context");
+        return CP::TGeometryId();
+    }
+#endif
+
+    const CP::TChannelMap::Record* record = FindChannel(cid);
+    if (!record || !record->GetGeometryId().IsValid()) {
+        CaptWarn("Geometry for channel is not found: " << cid);
+        return CP::TGeometryId();
+    }
+        
+    return record->GetGeometryId();
+}
+
+CP::TGeometryId CP::TChannelMap::GetGeometry(int wirenumber) const {
+    // Make sure that the identifier is valid.
+    if (wirenumber == -1) {
+        CaptError("Invalid wire number cannot be translated to a geometry");
+        return CP::TGeometryId();
+    }
+    
+    // Make sure that we know what the current context is.  The channel to
+    // geometry mapping changes with time.
+    if (!GetContext().IsValid()) {
+        CaptError("Invalid event context cannot be translated to geometry id: "
+                  << GetContext());
+        return CP::TGeometryId();
+    }
+    
+    // The current context is for the MC, so the channel can be generated
+    // algorithmically.
+    if (GetContext().IsMC()) {
+        // There isn't a defined wire number for a MC channel.  The MC wires
+        // are defined by the geometry position, not the position around the
+        // TPC frame.
+        return CP::TGeometryId();
+    }
+    
+    // The context is valid, and not for the MC, so it should be for the
+    // detector.  This shouldn't never happen, but it might.
+#ifdef CHECK_DETECTOR_CONTEXT
+    if (!GetContext().IsDetector()) {
+        CaptError("Channel requested for invalid event context");
+        return CP::TGeometryId();
+    }
+#endif
+
+    CP::TGeometryId geomId = GetWireGeometry(wirenumber);
+    if (!geomId.IsValid()) {
+        CaptWarn("Geometry for object not found: " << wirenumber);
+        return CP::TGeometryId();
+    }
+        
+    return geomId;
+}
+
+int CP::TChannelMap::GetGeometryCount(CP::TChannelId id) const {
+    if (!id.IsValid()) return 0;
+    return 1;
+}
+
+int CP::TChannelMap::GetWireNumber(CP::TChannelId cid) const {
+    // Make sure that the identifier is valid.
+    if (!cid.IsValid()) {
+        CaptError("Invalid channel id can not be translated to a wire number");
+        return -1;
+    }
+    
+    // Make sure that we know what the current context is.  The channel to
+    // geometry mapping changes with time.
+    if (!GetContext().IsValid()) {
+        CaptError("Need valid event context to translate"
+                  << " channel id to wire number: "
+                  << GetContext());
+        return -1;
+    }
+    
+    // The current context is for the MC, so the channel can be generated
+    // algorithmically.
+    if (cid.IsMCChannel()) {
+#ifdef CHECK_MC_CONTEXT
+        if (GetContext().IsMC()) {
+            CaptError("Channel requested for invalid event context");
+            return -1;
+        }
+#endif
+        // There isn't a defined wire number for a MC channel.  The MC wires
+        // are defined by the geometry position, not the position around the
+        // TPC frame.
+        return -1;
+    }
+    
+    // The context is valid, and not for the MC, so it should be for the
+    // detector.  This shouldn't never happen, but it might.
+#ifdef CHECK_DETECTOR_CONTEXT
+    if (GetContext().IsDetector()) {
+        CaptError("Channel requested for invalid event context");
+        return -1;
+    }
+#endif
+
+    const CP::TChannelMap::Record* record = FindChannel(cid);
+    if (!record || record->fWire < 0) {
+        CaptWarn("Channel for object not found: " << cid);
+        return -1;
+    }
+        
+    return record->fWire;
+}
+
+int CP::TChannelMap::GetWireNumber(CP::TGeometryId gid) const {
+    // Make sure that the identifier is valid.
+    if (!gid.IsValid()) {
+        CaptError("Invalid geometry id can not be translated to a wire number");
+        return -1;
+    }
+    
+    // Make sure that we know what the current context is.  The channel to
+    // geometry mapping changes with time.
+    if (!GetContext().IsValid()) {
+        CaptError("Need valid event context to translate"
+                  << " geometry id to wire number: "
+                  << GetContext());
+        return -1;
+    }
+    
+    // The current context is for the MC, so the channel can be generated
+    // algorithmically.
+    if (GetContext().IsMC()) {
+        // There isn't a defined wire number for a MC channel.  The MC wires
+        // are defined by the geometry position, not the position around the
+        // TPC frame.
+        return -1;
+    }
+    
+    // The context is valid, and not for the MC, so it should be for the
+    // detector.  This shouldn't never happen, but it might.
+#ifdef CHECK_DETECTOR_CONTEXT
+    if (!GetContext().IsDetector()) {
+        CaptError("Channel requested for invalid event context");
+        return -1;
+    }
+#endif
+
+    int wire = GetGeometryWire(gid);
+    if (wire < 0) {
+        CaptWarn("Geometry for object not found: " << gid);
+        return -1;
+    }
+        
+    return wire;
+}
+
+
+int CP::TChannelMap::GetMotherboard(CP::TChannelId cid) const {
+    // Make sure that we have an event context since the channel to geometry
+    // mapping changes with time.
+    if (!GetContext().IsValid()) {
+        CaptWarn("Need valid event context to translate channel to geometry");
+        return -1;
+    }
+
+    // Make sure this is a valid channel and flag an error if not.
+    if (!cid.IsValid()) {
+        CaptError("Invalid channel cannot be translated to geometry");
+        return -1;
+    }
+
+    // The current context is for the MC, so the channel can be generated
+    // algorithmically.
+    if (cid.IsMCChannel()) {
+        return -1;
+    }
+    
+    // The context is valid, and not for the MC, so it should be for the
+    // detector.  This shouldn't never happen, but it might.
+    if (!GetContext().IsDetector()) {
+        CaptWarn("Channel requested for invalid event context");
+        return -1;
+    }
+
+    const CP::TChannelMap::Record* record = FindChannel(cid);
+    if (!record) {
+        return -1;
+    }
+        
+    return record->fMotherboard;
+}
+
+int CP::TChannelMap::GetASIC(CP::TChannelId cid) const {
+    // Make sure that we have an event context since the channel to geometry
+    // mapping changes with time.
+    if (!GetContext().IsValid()) {
+        CaptWarn("Need valid event context to translate channel to geometry");
+        return -1;
+    }
+
+    // Make sure this is a valid channel and flag an error if not.
+    if (!cid.IsValid()) {
+        CaptError("Invalid channel cannot be translated to geometry");
+        return -1;
+    }
+
+    // The current context is for the MC, so the channel can be generated
+    // algorithmically.
+    if (cid.IsMCChannel()) {
+        return -1;
+    }
+    
+    // The context is valid, and not for the MC, so it should be for the
+    // detector.  This shouldn't never happen, but it might.
+    if (!GetContext().IsDetector()) {
+        CaptWarn("Channel requested for invalid event context");
+        return -1;
+    }
+
+    const CP::TChannelMap::Record* record = FindChannel(cid);
+    if (!record) {
+        return -1;
+    }
+        
+    return record->fASIC;
+}
+
+int CP::TChannelMap::GetASICChannel(CP::TChannelId cid) const {
+    // Make sure that we have an event context since the channel to geometry
+    // mapping changes with time.
+    if (!GetContext().IsValid()) {
+        CaptWarn("Need valid event context to translate channel to geometry");
+        return -1;
+    }
+
+    // Make sure this is a valid channel and flag an error if not.
+    if (!cid.IsValid()) {
+        CaptError("Invalid channel cannot be translated to geometry");
+        return -1;
+    }
+
+    // The current context is for the MC, so the channel can be generated
+    // algorithmically.
+    if (cid.IsMCChannel()) {
+        return -1;
+    }
+    
+    // The context is valid, and not for the MC, so it should be for the
+    // detector.  This shouldn't never happen, but it might.
+    if (!GetContext().IsDetector()) {
+        CaptWarn("Channel requested for invalid event context");
+        return -1;
+    }
+
+    const CP::TChannelMap::Record* record = FindChannel(cid);
+    if (!record) {
+        return -1;
+    }
+        
+    return record->fASICChannel;
+}
+
+
+bool CP::TChannelMap::GetChannelRecord(CP::TChannelId cid,
+                                        CP::TChannelMap::Record& record) const {
+    ResetRecord(record, cid);
+
+    // Make sure that we have an event context since the channel to geometry
+    // mapping changes with time.
+    if (!GetContext().IsValid()) {
+        CaptWarn("Need valid event context to translate channel to geometry");
+        return false;
+    }
+
+    // Make sure this is a valid channel and flag an error if not.
+    if (!cid.IsValid()) {
+        CaptError("Invalid channel cannot be translated to geometry");
+        return false;
+    }
+
+    // The channel is for the MC, so the geometry can be generated
+    // algorithmically.  There isn't a wire number, or electronics.
+    if (cid.IsMCChannel()) {
+        CP::TGeometryId geomId = GetGeometry(cid);
+        record.fGeometry = geomId.AsInt();
+        return geomId.IsValid();
+    }
+    
+    // The context is valid, and not for the MC, so it should be for the
+    // detector.  This shouldn't never happen, but it might.
+    if (!GetContext().IsDetector()) {
+        CaptWarn("Channel requested for invalid event context");
+        return false;
+    }
+
+    const CP::TChannelMap::Record* found = FindChannel(cid);
+    if (!found) return false;
+
+    record = *found;
+    return true;
+}
+
+void CP::TChannelMap::FindChannel(const CP::TChannelId* ids, int n,
+                                  const Record** records) const {
+    // Find the slots for a block of channels and prefetch the slot table
+    // entries, then find the records and prefetch them, so the loads for
+    // the block are in flight together instead of one after another.
+    int slots[kBatchBlock];
+    for (int first = 0; first < n; first += kBatchBlock) {
+        int size = std::min(kBatchBlock, n - first);
+        for (int i = 0; i < size; ++i) {
+            CP::TChannelId cid = ids[first+i];
+            int slot = -1;
+            if (cid.IsValid() && !cid.IsMCChannel()) slot = fIndex.GetSlot(cid);
+            slots[i] = slot;
+            if (slot >= 0) Prefetch(&fSlotRecord[slot]);
+        }
+        for (int i = 0; i < size; ++i) {
+            const Record* record = NULL;
+            int r = (slots[i] < 0)? -1: fSlotRecord[slots[i]];
+            if (r >= 0) {
+                record = &fRecords[r];
+                Prefetch(record);
+            }
+            records[first+i] = record;
+        }
+    }
+}
+
+void CP::TChannelMap::FindGeometry(const CP::TGeometryId* ids, int n,
+                                   const Record** records) const {
+    for (int i = 0; i < n; ++i) records[i] = FindGeometry(ids[i]);
+}
+
+bool CP::TChannelMap::CheckBatchContext(bool detector) const {
+    if (!GetContext().IsValid()) {
+        CaptError("Need valid event context for a batch translation: "
+                  << GetContext());
+        return false;
+    }
+    if (detector && !GetContext().IsDetector()) {
+        CaptWarn("Batch translation requested for invalid event context");
+        return false;
+    }
+    return true;
+}
+
+int CP::TChannelMap::GetGeometry(const CP::TChannelId* ids, int n,
+                                 CP::TGeometryId* geomIds,
+                                 std::vector<bool>* missing) const {
+    if (missing) missing->assign(n,true);
+    if (!CheckBatchContext(false)) {
+        std::fill(geomIds, geomIds+n, CP::TGeometryId());
+        return n;
+    }
+    int count = BatchLookup(
+        *this, ids, n, geomIds, CP::TGeometryId(), missing,
+        [] (const Record& r, CP::TGeometryId& v) {
+            v = r.GetGeometryId();
+            return v.IsValid();
+        });
+    // The MC channels are translated algorithmically.
+    for (int i = 0; i < n; ++i) {
+        if (!ids[i].IsValid() || !ids[i].IsMCChannel()) continue;
+        geomIds[i] = MCGeometry(ids[i]);
+        if (!geomIds[i].IsValid()) continue;
+        if (missing) (*missing)[i] = false;
+        --count;
+    }
+    return count;
+}
+
+int CP::TChannelMap::GetChannel(const CP::TGeometryId* ids, int n,
+                                CP::TChannelId* chanIds,
+                                std::vector<bool>* missing) const {
+    if (missing) missing->assign(n,true);
+    if (!CheckBatchContext(false)) {
+        std::fill(chanIds, chanIds+n, CP::TChannelId());
+        return n;
+    }
+    int count = 0;
+    if (GetContext().IsMC()) {
+        for (int i = 0; i < n; ++i) {
+            chanIds[i] = ids[i].IsValid()? MCChannel(ids[i]): CP::TChannelId();
+            if (!chanIds[i].IsValid()) {
+                ++count;
+                continue;
+            }
+            if (missing) (*missing)[i] = false;
+        }
+        return count;
+    }
+    const Record* records[kBatchBlock];
+    for (int first = 0; first < n; first += kBatchBlock) {
+        int size = std::min(kBatchBlock, n - first);
+        FindGeometry(ids+first, size, records);
+        for (int i = 0; i < size; ++i) {
+            CP::TChannelId cid;
+            if (records[i]) cid = records[i]->GetChannelId();
+            chanIds[first+i] = cid;
+            bool found = cid.IsValid();
+            if (!found) ++count;
+            if (missing) (*missing)[first+i] = !found;
+        }
+    }
+    return count;
+}
+
+int CP::TChannelMap::GetWireNumber(const CP::TChannelId* ids, int n,
+                                   int* wires,
+                                   std::vector<bool>* missing) const {
+    if (missing) missing->assign(n,true);
+    if (!CheckBatchContext(false)) {
+        std::fill(wires, wires+n, -1);
+        return n;
+    }
+    return BatchLookup(
+        *this, ids, n, wires, -1, missing,
+        [] (const Record& r, int& v) {v = r.fWire; return v >= 0;});
+}
+
+int CP::TChannelMap::GetMotherboard(const CP::TChannelId* ids, int n,
+                                    int* motherboards,
+                                    std::vector<bool>* missing) const {
+    if (missing) missing->assign(n,true);
+    if (!CheckBatchContext(true)) {
+        std::fill(motherboards, motherboards+n, -1);
+        return n;
+    }
+    return BatchLookup(
+        *this, ids, n, motherboards, -1, missing,
+        [] (const Record& r, int& v) {v = r.fMotherboard; return v >= 0;});
+}
+
+int CP::TChannelMap::GetASIC(const CP::TChannelId* ids, int n,
+                             int* asics,
+                             std::vector<bool>* missing) const {
+    if (missing) missing->assign(n,true);
+    if (!CheckBatchContext(true)) {
+        std::fill(asics, asics+n, -1);
+        return n;
+    }
+    return BatchLookup(
+        *this, ids, n, asics, -1, missing,
+        [] (const Record& r, int& v) {v = r.fASIC; return v >= 0;});
+}
+
+int CP::TChannelMap::GetASICChannel(const CP::TChannelId* ids, int n,
+                                    int* asicChannels,
+                                    std::vector<bool>* missing) const {
+    if (missing) missing->assign(n,true);
+    if (!CheckBatchContext(true)) {
+        std::fill(asicChannels, asicChannels+n, -1);
+        return n;
+    }
+    return BatchLookup(
+        *this, ids, n, asicChannels, -1, missing,
+        [] (const Record& r, int& v) {v = r.fASICChannel; return v >= 0;});
+}
+
+int CP::TChannelMap::GetChannelRecord(const CP::TChannelId* ids, int n,
+                                      Record* records,
+                                      std::vector<bool>* missing) const {
+    if (missing) missing->assign(n,true);
+    bool valid = CheckBatchContext(false);
+    bool detector = valid && GetContext().IsDetector();
+    const Record* found[kBatchBlock];
+    int count = 0;
+    for (int first = 0; first < n; first += kBatchBlock) {
+        int size = std::min(kBatchBlock, n - first);
+        FindChannel(ids+first, size, found);
+        for (int i = 0; i < size; ++i) {
+            CP::TChannelId cid = ids[first+i];
+            Record& record = records[first+i];
+            ResetRecord(record, cid);
+            bool ok = false;
+            if (!valid || !cid.IsValid()) ok = false;
+            else if (cid.IsMCChannel()) {
+                record.fGeometry = MCGeometry(cid).AsInt();
+                ok = record.GetGeometryId().IsValid();
+            }
+            else if (detector && found[i]) {
+                record = *found[i];
+                ok = true;
+            }
+            if (!ok) ++count;
+            if (missing) (*missing)[first+i] = !ok;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,415 @@
+#ifndef TChannelMap_hxx_seen
+#define TChannelMap_hxx_seen
+
+#include <TEventContext.hxx>
+#include <TChannelId.hxx>
+#include <TGeometryId.hxx>
+
+#include "TChannelIndex.hxx"
+#include "TValidityRange.hxx"
+
+#include <utility>
+#include <vector>
+
+namespace CP {
+    class TChannelMap;
+};
+
+/// The channel mapping for a range of event contexts.  This holds one
+/// record for each electronics channel along with the translations for the
+/// wire number.  The map is filled using AddChannel() and AddWire(), and
+/// then Build() must be called before it is used.  After it has been built,
+/// all of the lookups are done with array indexing.
+///
+/// Maps are created by CP::TChannelInfo, and a map for a particular event
+/// context can be requested with CP::TChannelInfo::GetChannelMap().  Once a
+/// map has been built it isn't changed, so a thread can keep a map (a
+/// "handle" for the context) and do lookups with it without touching any
+/// shared state.  The lookup methods behave exactly like the ones in
+/// CP::TChannelInfo.
+///
+/// \code
+/// std::shared_ptr<const CP::TChannelMap> channelMap
+///     = CP::TChannelInfo::Get().GetChannelMap(event.GetContext());
+/// CP::TGeometryId geomId = channelMap->GetGeometry(channelId);
+/// \endcode
+class CP::TChannelMap {
+public:
+    /// Everything that is known about an electronics channel.  This is a
+    /// plain old data structure so that tables of records can be copied and
+    /// saved directly.  Fields that are not known are set to -1 (or to the
+    /// value for an invalid identifier).
+    struct Record {
+        /// The electronics channel as CP::TChannelId::AsUInt().
+        UInt_t fChannel;
+        /// The geometry as CP::TGeometryId::AsInt().
+        int fGeometry;
+        /// The wire number around the TPC.
+        int fWire;
+        /// The cold motherboard.
+        short fMotherboard;
+        /// The cold ASIC on the motherboard.
+        short fASIC;
+        /// The channel on the ASIC.
+        short fASICChannel;
+        /// Reserved to keep the record aligned.
+        short fSpare;
+
+        /// Get the channel identifier.
+        CP::TChannelId GetChannelId() const {
+            return CP::TChannelId(fChannel);
+        }
+
+        /// Get the geometry identifier.
+        CP::TGeometryId GetGeometryId() const {
+            return CP::TGeometryId(fGeometry);
+        }
+    };
+
+    /// The types of electronics groups.  The channels can be grouped by
+    /// the cold motherboard, the cold ASIC, the crate, or the front end
+    /// module (FEM).
+    enum GroupType {
+        kMotherboardGroup,
+        kASICGroup,
+        kCrateGroup,
+        kFEMGroup,
+        kGroupTypes
+    };
+
+    /// An index of the channels in each electronics group.  The index is
+    /// in compressed sparse row format: the records for group "g" are
+    /// fRecord[fOffset[g]] up to (but not including) fRecord[fOffset[g+1]],
+    /// so the channels in a group can be iterated as a contiguous array.
+    /// The records are positions for GetRecord(), and are in channel order
+    /// within each group.  The groups are sorted by the key.  This is used
+    /// for coherent noise removal.
+    ///
+    /// \code
+    /// const CP::TChannelMap::Groups& asics
+    ///     = channelMap->GetGroups(CP::TChannelMap::kASICGroup);
+    /// for (int g = 0; g < asics.GetGroupCount(); ++g) {
+    ///     for (const int* r = asics.Begin(g); r != asics.End(g); ++r) {
+    ///         CP::TChannelId id = channelMap->GetRecord(*r).GetChannelId();
+    ///     }
+    /// }
+    /// \endcode
+    struct Groups {
+        /// Get the number of groups.
+        int GetGroupCount() const {return fKey.size();}
+
+        /// Get the number of channels in a group.
+        int GetSize(int group) const {
+            return fOffset[group+1] - fOffset[group];
+        }
+
+        /// Get the first record in a group.
+        const int* Begin(int group) const {
+            return fRecord.empty()? NULL: &fRecord[0] + fOffset[group];
+        }
+
+        /// Get the end of the records in a group.
+        const int* End(int group) const {
+            return fRecord.empty()? NULL: &fRecord[0] + fOffset[group+1];
+        }
+
+        /// The key for each group.  The first value is the motherboard or
+        /// crate.  The second value is the ASIC on the motherboard, or the
+        /// FEM in the crate, and is -1 for motherboard and crate groups.
+        std::vector< std::pair<int,int> > fKey;
+
+        /// The offset of the first record for each group.  This has one
+        /// more entry than the number of groups.
+        std::vector<int> fOffset;
+
+        /// The records in each group.
+        std::vector<int> fRecord;
+
+        /// The group for each record, or -1 if the record isn't in a
+        /// group.
+        std::vector<int> fGroup;
+    };
+
+    TChannelMap();
+
+    /// Map a geometry identifier into a channel identifier.  See
+    /// CP::TChannelInfo::GetChannel().
+    CP::TChannelId GetChannel(CP::TGeometryId id, int index=0) const;
+
+    /// Get the channel identifier from the wire number.
+    CP::TChannelId GetChannel(int wire, int index=0) const;
+
+    /// Get the number of electronics channels that map to a particular
+    /// geometry identifier.
+    int GetChannelCount(CP::TGeometryId id) const;
+
+    /// Map a channel identifier into a geometry identifier.  See
+    /// CP::TChannelInfo::GetGeometry().
+    CP::TGeometryId GetGeometry(CP::TChannelId id) const;
+
+    /// Get the geometry identifier from the wire number.
+    CP::TGeometryId GetGeometry(int wire) const;
+
+    /// Get the number of geometry objects that map to a particular channel.
+    int GetGeometryCount(CP::TChannelId id) const;
+
+    /// Get the wire number around the outside of the TPC for a channel.
+    int GetWireNumber(CP::TChannelId cid) const;
+    
+    /// Get the wire number around the outside of the TPC for a geometry
+    /// object.
+    int GetWireNumber(CP::TGeometryId id) const;
+
+    /// Get the cold motherboard associated with a channel id.
+    int GetMotherboard(CP::TChannelId id) const;
+
+    /// Get the cold ASIC associated with the channel id.
+    int GetASIC(CP::TChannelId id) const;
+
+    /// Get the channel on the asic associated with the channel id.
+    int GetASICChannel(CP::TChannelId id) const;
+
+    /// Get everything known about a channel with a single lookup.  See
+    /// CP::TChannelInfo::GetChannelRecord().
+    bool GetChannelRecord(CP::TChannelId cid, Record& record) const;
+
+    /// \name Batch lookups
+    /// Translate a contiguous array of "n" identifiers into an output array
+    /// that must have room for "n" values.  The context is checked once for
+    /// the whole batch.  Entries that can't be translated are set to an
+    /// invalid identifier (or -1), and are not reported with a warning.
+    /// Instead, if "missing" is not NULL, it is resized to "n" and the
+    /// entries that could not be translated are set to true.  The return
+    /// value is the number of entries that could not be translated.
+    /// @{
+
+    /// Translate an array of channels into geometry identifiers.
+    int GetGeometry(const CP::TChannelId* ids, int n,
+                    CP::TGeometryId* geomIds,
+                    std::vector<bool>* missing = NULL) const;
+
+    /// Translate an array of geometry identifiers into channels.
+    int GetChannel(const CP::TGeometryId* ids, int n,
+                   CP::TChannelId* chanIds,
+                   std::vector<bool>* missing = NULL) const;
+
+    /// Translate an array of channels into wire numbers.
+    int GetWireNumber(const CP::TChannelId* ids, int n,
+                      int* wires,
+                      std::vector<bool>* missing = NULL) const;
+
+    /// Translate an array of channels into cold motherboards.
+    int GetMotherboard(const CP::TChannelId* ids, int n,
+                       int* motherboards,
+                       std::vector<bool>* missing = NULL) const;
+
+    /// Translate an array of channels into cold ASICs.
+    int GetASIC(const CP::TChannelId* ids, int n,
+                int* asics,
+                std::vector<bool>* missing = NULL) const;
+
+    /// Translate an array of channels into the channel on the cold ASIC.
+    int GetASICChannel(const CP::TChannelId* ids, int n,
+                       int* asicChannels,
+                       std::vector<bool>* missing = NULL) const;
+
+    /// Fill the records for an array of channels.  The records for MC
+    /// channels are filled as in GetChannelRecord().
+    int GetChannelRecord(const CP::TChannelId* ids, int n,
+                         Record* records,
+                         std::vector<bool>* missing = NULL) const;
+
+    /// Find the records for an array of detector channels.  The pointer is
+    /// NULL for channels that are not in the map (including MC channels).
+    /// This does not check the context.  The index and record tables are
+    /// prefetched a block of channels at a time.
+    void FindChannel(const CP::TChannelId* ids, int n,
+                     const Record** records) const;
+
+    /// Find the records for an array of geometry identifiers.  The pointer
+    /// is NULL for geometry that isn't connected to a channel.  This does
+    /// not check the context.
+    void FindGeometry(const CP::TGeometryId* ids, int n,
+                      const Record** records) const;
+    /// @}
+
+    /// \name Filling the map
+    /// These are used by CP::TChannelInfo to build a new map.
+    /// @{
+
+    /// Remove everything from the map.
+    void Clear();
+
+    /// Add an electronics channel to the map.  If the channel has already
+    /// been added, then the fields that are valid in this call replace the
+    /// previous values.
+    void AddChannel(CP::TChannelId cid,
+                    CP::TGeometryId gid,
+                    int wire = -1,
+                    int motherboard = -1,
+                    int asic = -1,
+                    int asicChannel = -1);
+
+    /// Add an array of records to the map.  This is the same as calling
+    /// AddChannel() for each record.
+    void AddRecords(const Record* records, int n);
+
+    /// Use an external array of records as the records for the map.  The
+    /// records must be sorted by channel without duplicates, and must stay
+    /// valid for the lifetime of the map.  The records are not copied.  This
+    /// replaces any channels that were added with AddChannel().
+    void UseRecords(const Record* records, int n);
+
+    /// Add the geometry for a wire number.
+    void AddWire(CP::TGeometryId gid, int wire);
+
+    /// Build the indices for the map.  This must be called after all of the
+    /// channels and wires have been added.
+    void Build();
+
+    /// Set the event context that was used to load the map.
+    void SetContext(const CP::TEventContext& context) {fContext = context;}
+
+    /// Set the range of event contexts where this map is valid.
+    void SetValidity(const CP::TValidityRange& validity) {
+        fValidity = validity;
+    }
+    /// @}
+
+    /// Get the event context that was used to load the map.  The map is
+    /// valid for any context in the validity range, but all of those
+    /// contexts share the same partition, and are all MC or all detector
+    /// contexts.  The context is invalid for an empty map.
+    const CP::TEventContext& GetContext() const {return fContext;}
+
+    /// Get the range of event contexts where this map is valid.
+    const CP::TValidityRange& GetValidity() const {return fValidity;}
+
+    /// Get the approximate amount of memory used by the map in bytes.
+    std::size_t GetMemoryUsage() const;
+
+    /// Get the number of channel records.
+    int GetRecordCount() const {return fRecordCount;}
+
+    /// Get a record by position.  The records are sorted by channel.
+    const Record& GetRecord(int i) const {return fRecordData[i];}
+
+    /// Get the index of the channels in each electronics group.  The index
+    /// is built with the map, so this doesn't do any work.
+    const Groups& GetGroups(GroupType type) const {return fGroups[type];}
+
+    /// Get the electronics group for a channel.  This returns -1 if the
+    /// channel isn't in the map, or isn't in a group of the type.
+    int GetGroup(GroupType type, CP::TChannelId cid) const {
+        int slot = fIndex.GetSlot(cid);
+        if (slot < 0) return -1;
+        int r = fSlotRecord[slot];
+        if (r < 0) return -1;
+        return fGroups[type].fGroup[r];
+    }
+
+    /// Find the record for an electronics channel.  This returns NULL if the
+    /// channel isn't in the map.
+    const Record* FindChannel(CP::TChannelId cid) const {
+        int slot = fIndex.GetSlot(cid);
+        if (slot < 0) return NULL;
+        int r = fSlotRecord[slot];
+        if (r < 0) return NULL;
+        return &fRecordData[r];
+    }
+
+    /// Find the record for the channel attached to a wire number.  This
+    /// returns NULL if the wire isn't connected to a channel.
+    const Record* FindWire(int wire) const {
+        if (wire < 0 || (int) fWireRecord.size() <= wire) return NULL;
+        int r = fWireRecord[wire];
+        if (r < 0) return NULL;
+        return &fRecordData[r];
+    }
+
+    /// Find the record for the channel attached to a geometry object.  This
+    /// returns NULL if the geometry isn't connected to a channel.
+    const Record* FindGeometry(CP::TGeometryId gid) const;
+
+    /// Get the geometry for a wire number.  This returns an invalid
+    /// identifier if the wire number is unknown.
+    CP::TGeometryId GetWireGeometry(int wire) const {
+        if (wire < 0 || (int) fWireGeometry.size() <= wire) {
+            return CP::TGeometryId();
+        }
+        return fWireGeometry[wire];
+    }
+
+    /// Get the wire number for a geometry object.  This returns -1 if the
+    /// geometry doesn't have a wire number.
+    int GetGeometryWire(CP::TGeometryId gid) const;
+
+private:
+    /// Forbid copying since the map may point to its own records.
+    /// @{
+    TChannelMap(const TChannelMap&);
+    TChannelMap& operator=(const TChannelMap&);
+    /// @}
+
+    /// Sort the added records and merge duplicate channels.
+    void MergeRecords();
+
+    /// Build the dense indices for the records.
+    void BuildIndex();
+
+    /// Build the index of the electronics groups.
+    void BuildGroups();
+
+    /// Check that the context can be used for a batch lookup, and report an
+    /// error if it can't.  If "detector" is true, the context must also be
+    /// for the detector.
+    bool CheckBatchContext(bool detector) const;
+
+    /// Find the plane and the wire in the plane for a geometry identifier.
+    /// This returns false if the identifier is not a wire.
+    static bool FindPlaneWire(CP::TGeometryId id, int& plane, int& wire);
+
+    /// The event context used to load the map.
+    CP::TEventContext fContext;
+
+    /// The range of event contexts where the map is valid.
+    CP::TValidityRange fValidity;
+
+    /// The channel records added to the map.  After Build() is called, they
+    /// are sorted by channel.
+    std::vector<Record> fRecords;
+
+    /// The records used for lookups.  This points to either fRecords, or an
+    /// external array provided with UseRecords().
+    const Record* fRecordData;
+
+    /// The number of records used for lookups.
+    int fRecordCount;
+
+    /// True if fRecordData points to an external array.
+    bool fExternal;
+
+    /// The dense index of the electronics channels.
+    CP::TChannelIndex fIndex;
+
+    /// The record for each channel slot, or -1.
+    std::vector<int> fSlotRecord;
+
+    /// The record for each wire number, or -1.
+    std::vector<int> fWireRecord;
+
+    /// The record for each wire in a plane, or -1.  This is indexed by the
+    /// plane, and then the wire number in the plane.
+    std::vector<int> fPlaneRecord[3];
+
+    /// The geometry id for each wire number.
+    std::vector<CP::TGeometryId> fWireGeometry;
+
+    /// The wire number for each wire in a plane, or -1.  This is indexed by
+    /// the plane, and then the wire number in the plane.
+    std::vector<int> fPlaneWire[3];
+
+    /// The index of the channels in each type of electronics group.
+    Groups fGroups[kGroupTypes];
+};
+#endif
@@ -0,0 +1,267 @@
+#include "TChannelMapFile.hxx"
+
+#include <TCaptLog.hxx>
+#include <CaptGeomId.hxx>
+#include <TChannelId.hxx>
+#include <TTPCChannelId.hxx>
+#include <TGeometryId.hxx>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace {
+    // The magic string at the start of a binary channel map.
+    const char kMagic[8] = {'C','A','P','T','C','M','A','P'};
+
+    // Order the records by the channel.
+    bool RecordChannelLess(const CP::TChannelMap::Record& lhs,
+                           const CP::TChannelMap::Record& rhs) {
+        return lhs.fChannel < rhs.fChannel;
+    }
+}
+
+CP::TChannelMapFile::TChannelMapFile()
+    : fRecords(NULL), fRecordCount(0), fMapped(NULL), fMappedSize(0) {}
+
+CP::TChannelMapFile::~TChannelMapFile() {
+    Close();
+}
+
+void CP::TChannelMapFile::Close() {
+    if (fMapped) munmap(fMapped, fMappedSize);
+    fMapped = NULL;
+    fMappedSize = 0;
+    fStorage.clear();
+    fRecords = NULL;
+    fRecordCount = 0;
+}
+
+bool CP::TChannelMapFile::Open(const std::string& name) {
+    Close();
+    if (Map(name)) return true;
+    if (fMapped) {
+        // This was a binary file, but it's corrupted.
+        Close();
+        return false;
+    }
+    if (!ReadText(name, fStorage)) return false;
+    fRecordCount = fStorage.size();
+    if (fRecordCount > 0) fRecords = &fStorage[0];
+    return true;
+}
+
+bool CP::TChannelMapFile::Map(const std::string& name) {
+    int fd = open(name.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0
+        || info.st_size < (off_t) sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+
+    // Check the magic string before mapping so text files fall through.
+    char magic[sizeof(kMagic)];
+    if (read(fd, magic, sizeof(magic)) != (ssize_t) sizeof(magic)
+        || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+        close(fd);
+        return false;
+    }
+
+    void* mapped = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        CaptError("Unable to map channel map " << name);
+        return false;
+    }
+    fMapped = mapped;
+    fMappedSize = info.st_size;
+
+    const Header* header = static_cast<const Header*>(fMapped);
+    if (header->fByteOrder != (UInt_t) kByteOrder) {
+        CaptError("Channel map " << name
+                  << " was written with a different byte order");
+        return false;
+    }
+    if (header->fVersion != kVersion) {
+        CaptError("Channel map " << name << " has version "
+                  << header->fVersion << " (expected " << kVersion << ")");
+        return false;
+    }
+    if (header->fRecordSize != sizeof(CP::TChannelMap::Record)) {
+        CaptError("Channel map " << name << " has wrong record size");
+        return false;
+    }
+    if (fMappedSize != sizeof(Header)
+        + header->fRecordCount*sizeof(CP::TChannelMap::Record)) {
+        CaptError("Channel map " << name << " has wrong size");
+        return false;
+    }
+    const CP::TChannelMap::Record* records
+        = reinterpret_cast<const CP::TChannelMap::Record*>(header+1);
+    if (Checksum(records, header->fRecordCount) != header->fChecksum) {
+        CaptError("Channel map " << name << " has a bad checksum");
+        return false;
+    }
+
+    fRecords = records;
+    fRecordCount = header->fRecordCount;
+    CaptLog("Mapped " << fRecordCount << " channels from " << name);
+    return true;
+}
+
+bool CP::TChannelMapFile::WriteBinary(
+    const std::string& name,
+    const std::vector<CP::TChannelMap::Record>& records) {
+    Header header;
+    std::memcpy(header.fMagic, kMagic, sizeof(kMagic));
+    header.fByteOrder = kByteOrder;
+    header.fVersion = kVersion;
+    header.fRecordSize = sizeof(CP::TChannelMap::Record);
+    header.fRecordCount = records.size();
+    header.fChecksum = Checksum(records.empty()? NULL: &records[0],
+                                records.size());
+
+    std::ofstream output(name.c_str(), std::ios::binary|std::ios::trunc);
+    if (!output.is_open()) {
+        CaptError("Unable to write channel map " << name);
+        return false;
+    }
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!records.empty()) {
+        output.write(reinterpret_cast<const char*>(&records[0]),
+                     records.size()*sizeof(CP::TChannelMap::Record));
+    }
+    return output.good();
+}
+
+UInt_t CP::TChannelMapFile::Checksum(const CP::TChannelMap::Record* records,
+                                     int n) {
+    // This is the 32 bit FNV-1a hash of the record bytes.
+    UInt_t hash = 2166136261U;
+    const unsigned char* bytes
+        = reinterpret_cast<const unsigned char*>(records);
+    std::size_t size = n*sizeof(CP::TChannelMap::Record);
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+bool CP::TChannelMapFile::ReadText(
+    const std::string& name,
+    std::vector<CP::TChannelMap::Record>& records) {
+    // Attach the file to a stream.
+    std::ifstream mapFile(name.c_str());
+    if (!mapFile.is_open()) {
+        CaptError("Unable to read channel map " << name);
+        return false;
+    }
+    std::map<CP::TChannelId,CP::TGeometryId> channelMap;
+    std::map<CP::TGeometryId,CP::TChannelId> geometryMap;
+    std::string line;
+    while (std::getline(mapFile,line)) {
+        std::size_t comment = line.find("#");
+        std::string tmp = line;
+        if (comment != std::string::npos) tmp.erase(comment);
+        // The minimum valid date, time and hash is 22 characters.  
+        if (tmp.size()<20) continue;
+        std::istringstream parser(tmp);
+        int crate;
+        int fem;
+        int channel;
+        int detector;
+        int plane;
+        int wire;
+        
+        parser >> crate;
+        if (parser.fail()) {
+            CaptError("Could not parse crate number: "<< line);
+            continue;
+        }
+
+        parser >> fem;
+        if (parser.fail()) {
+            CaptError("Could not parse fem number: "<< line);
+            continue;
+        }
+
+        parser >> channel;
+        if (parser.fail()) {
+            CaptError("Could not parse channel number: "<< line);
+            continue;
+        }
+
+        parser >> detector;
+        if (parser.fail()) {
+            CaptError("Could not parse detector number: "<< line);
+            continue;
+        }
+
+        parser >> plane;
+        if (parser.fail()) {
+            CaptError("Could not parse plane number: "<< line);
+            continue;
+        }
+
+        parser >> wire;
+        if (parser.fail()) {
+            CaptError("Could not parse wire number: "<< line);
+            continue;
+        }
+
+        CP::TChannelId cid;
+        CP::TGeometryId gid;
+        if (detector == CP::TChannelId::kTPC) {
+            cid = CP::TTPCChannelId(crate,fem,channel);
+            gid = CP::GeomId::Captain::Wire(plane,wire);
+        }
+        else {
+            CaptError("Unknown detector channel: " << line);
+            continue;
+        }
+
+        if (channelMap.find(cid) != channelMap.end()) {
+            CaptError("Channel already exists: " << line);
+            CaptError("   Duplicate " << gid);
+        }
+
+        if (geometryMap.find(gid) != geometryMap.end()) {
+            CaptError("Channel already exists: " << line);
+            CaptError("   Duplicate " << cid);
+        }
+
+        channelMap[cid] = gid;
+        geometryMap[gid] = cid;
+
+    }
+
+    records.clear();
+    records.reserve(channelMap.size());
+    for (std::map<CP::TChannelId,CP::TGeometryId>::iterator c
+             = channelMap.begin();
+         c != channelMap.end(); ++c) {
+        CP::TChannelMap::Record record;
+        record.fChannel = c->first.AsUInt();
+        record.fGeometry = c->second.AsInt();
+        record.fWire = -1;
+        record.fMotherboard = -1;
+        record.fASIC = -1;
+        record.fASICChannel = -1;
+        record.fSpare = 0;
+        records.push_back(record);
+    }
+    std::sort(records.begin(), records.end(), RecordChannelLess);
+
+    return true;
+}
@@ -0,0 +1,115 @@
+#ifndef TChannelMapFile_hxx_seen
+#define TChannelMapFile_hxx_seen
+
+#include "TChannelMap.hxx"
+
+#include <string>
+#include <vector>
+
+namespace CP {
+    class TChannelMapFile;
+};
+
+/// A channel map file used to override the channel mapping (see the
+/// CAPTCHANNELMAP environment variable used by CP::TChannelInfo).  The file
+/// can either be a text file, or a compiled binary file.  The text file has
+/// one channel per line with the columns
+///
+/// \code
+/// <crate> <fem> <channel> <detector> <plane> <wire>
+/// \endcode
+///
+/// and "#" starts a comment.  The binary file is produced from the text file
+/// using capt-channel-map-compile, and is a header followed by the
+/// CP::TChannelMap::Record for each channel sorted by channel.  The binary
+/// file is mapped into memory and the records are used directly, so there
+/// is no parsing, and no allocation for each channel.  The binary file is
+/// written in the native byte order, and a file written on a machine with a
+/// different byte order is rejected.
+class CP::TChannelMapFile {
+public:
+    /// The header at the start of a binary channel map file.
+    struct Header {
+        /// The file type.  This is always "CAPTCMAP".
+        char fMagic[8];
+        /// The byte order mark.  This is kByteOrder written in the byte
+        /// order of the machine that wrote the file.
+        UInt_t fByteOrder;
+        /// The version of the file format.
+        UInt_t fVersion;
+        /// The size of each record in bytes.
+        UInt_t fRecordSize;
+        /// The number of records following the header.
+        UInt_t fRecordCount;
+        /// The checksum of the records.
+        UInt_t fChecksum;
+    };
+
+    /// The current version of the binary file format.
+    enum {kVersion = 1};
+
+    /// The value of the byte order mark.
+    enum {kByteOrder = 0x01020304};
+
+    TChannelMapFile();
+    ~TChannelMapFile();
+
+    /// Open a channel map file.  If the file starts with the binary header,
+    /// then it is mapped into memory, otherwise it is read as a text file.
+    /// This returns false if the file can't be read.
+    bool Open(const std::string& name);
+
+    /// Close the file, and release the records.
+    void Close();
+
+    /// Get the number of records in the file.
+    int GetRecordCount() const {return fRecordCount;}
+
+    /// Get the records in the file sorted by channel.  The pointer is valid
+    /// until the file is closed.
+    const CP::TChannelMap::Record* GetRecords() const {return fRecords;}
+
+    /// True if the records are mapped from a binary file.
+    bool IsMapped() const {return fMapped != NULL;}
+
+    /// Read a text channel map file into a vector of records sorted by
+    /// channel.  This returns false if the file can't be opened.
+    static bool ReadText(const std::string& name,
+                         std::vector<CP::TChannelMap::Record>& records);
+
+    /// Write a binary channel map file.  The records must be sorted by
+    /// channel.  This returns false if the file can't be written.
+    static bool WriteBinary(
+        const std::string& name,
+        const std::vector<CP::TChannelMap::Record>& records);
+
+    /// Calculate the checksum of an array of records.
+    static UInt_t Checksum(const CP::TChannelMap::Record* records, int n);
+
+private:
+    /// Forbid copying since the object owns the mapped memory.
+    /// @{
+    TChannelMapFile(const TChannelMapFile&);
+    TChannelMapFile& operator=(const TChannelMapFile&);
+    /// @}
+
+    /// Map a binary file into memory.  This returns false if the file isn't
+    /// a valid binary channel map.
+    bool Map(const std::string& name);
+
+    /// The records in the file.  This points into fMapped or fStorage.
+    const CP::TChannelMap::Record* fRecords;
+
+    /// The number of records.
+    int fRecordCount;
+
+    /// The memory mapped from a binary file, or NULL.
+    void* fMapped;
+
+    /// The size of the mapped memory.
+    std::size_t fMappedSize;
+
+    /// The records read from a text file.
+    std::vector<CP::TChannelMap::Record> fStorage;
+};
+#endif
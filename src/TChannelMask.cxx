@@ -0,0 +1,37 @@
+#include "TChannelMask.hxx"
+
+CP::TChannelMask::TChannelMask() : fSize(0) {}
+
+void CP::TChannelMask::Reset(const CP::TChannelIndex& index) {
+    fIndex = index;
+    fSize = fIndex.GetSize();
+    fWords.assign((fSize + kWordBits - 1)/kWordBits, 0);
+}
+
+void CP::TChannelMask::Set(int slot, bool value) {
+    if (slot < 0 || fSize <= slot) return;
+    Word bit = Word(1) << (slot%kWordBits);
+    if (value) fWords[slot/kWordBits] |= bit;
+    else fWords[slot/kWordBits] &= ~bit;
+}
+
+int CP::TChannelMask::Count() const {
+    int count = 0;
+    for (std::size_t i = 0; i < fWords.size(); ++i) {
+        count += __builtin_popcountll(fWords[i]);
+    }
+    return count;
+}
+
+int CP::TChannelMask::Next(int slot) const {
+    if (slot < 0) slot = 0;
+    if (fSize <= slot) return -1;
+    std::size_t word = slot/kWordBits;
+    // Remove the bits before the slot in the first word.
+    Word bits = fWords[word] & (~Word(0) << (slot%kWordBits));
+    while (!bits) {
+        if (++word >= fWords.size()) return -1;
+        bits = fWords[word];
+    }
+    return word*kWordBits + __builtin_ctzll(bits);
+}
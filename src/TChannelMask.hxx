@@ -0,0 +1,75 @@
+#ifndef TChannelMask_hxx_seen
+#define TChannelMask_hxx_seen
+
+#include "TChannelIndex.hxx"
+
+#include <vector>
+
+namespace CP {
+    class TChannelMask;
+};
+
+/// A packed set of electronics channels.  There is one bit for each slot of
+/// a CP::TChannelIndex, so checking if a channel is in the set is an array
+/// access, and the channels in the set can be found by scanning 64 bits at a
+/// time.  This is used by CP::TChannelCalib to provide the mask of usable
+/// channels.  The channels in the set are visited using
+///
+/// \code
+/// for (int slot = mask.Next(0); slot >= 0; slot = mask.Next(slot+1)) {
+///     CP::TChannelId id = mask.GetIndex().GetChannel(slot);
+/// }
+/// \endcode
+class CP::TChannelMask {
+public:
+    /// The type used to save the bits.
+    typedef unsigned long long Word;
+
+    TChannelMask();
+
+    /// Set the index used for the mask, and remove all of the channels.
+    void Reset(const CP::TChannelIndex& index);
+
+    /// Get the index used to find the slot for a channel.
+    const CP::TChannelIndex& GetIndex() const {return fIndex;}
+
+    /// Get the number of slots covered by the mask.
+    int GetSize() const {return fSize;}
+
+    /// Add (or remove) the channel in a slot.
+    void Set(int slot, bool value = true);
+
+    /// Check if the channel in a slot is in the set.
+    bool Test(int slot) const {
+        if (slot < 0 || fSize <= slot) return false;
+        return (fWords[slot/kWordBits] >> (slot%kWordBits)) & 1;
+    }
+
+    /// Check if a channel is in the set.  Channels that are not covered by
+    /// the index are not in the set.
+    bool Test(CP::TChannelId id) const {return Test(fIndex.GetSlot(id));}
+
+    /// Get the number of channels in the set.
+    int Count() const;
+
+    /// Get the first slot at or after "slot" that is in the set, or -1 if
+    /// there isn't one.
+    int Next(int slot) const;
+
+    /// Get the packed bits.  Slot "i" is bit i%64 of word i/64.
+    const std::vector<Word>& GetWords() const {return fWords;}
+
+private:
+    /// The number of bits in a word.
+    enum {kWordBits = 64};
+
+    /// The index for the channels.
+    CP::TChannelIndex fIndex;
+
+    /// The number of slots.
+    int fSize;
+
+    /// The bits for each slot.
+    std::vector<Word> fWords;
+};
+#endif
@@ -0,0 +1,134 @@
+#include "TIgnoredWireList.hxx"
+
+#include <TCaptLog.hxx>
+#include <TRuntimeParameters.hxx>
+#include <CaptGeomId.hxx>
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+namespace {
+    // Make sure the list is only read once.
+    std::once_flag gIgnoredWireListOnce;
+}
+
+CP::TIgnoredWireList* CP::TIgnoredWireList::fIgnoredWireList = NULL;
+
+const CP::TIgnoredWireList& CP::TIgnoredWireList::Get() {
+    std::call_once(gIgnoredWireListOnce,
+                   [] () {fIgnoredWireList = new CP::TIgnoredWireList();});
+    return *fIgnoredWireList;
+}
+
+CP::TIgnoredWireList::TIgnoredWireList()
+    : fValid(false), fWireCount(0), fWordCount(0) {
+    std::vector<Entry> entries;
+
+    // Wire 1 of the V plane has always been ignored (it was used to mark
+    // that the list had been read), so keep it to preserve the results.
+    Entry marker = {1, 1, INT_MIN, INT_MAX};
+    entries.push_back(marker);
+
+    if (!CP::TRuntimeParameters::Get().HasParameter(
+            "captChanInfo.wire.ignore.file")) {
+        CaptError("File parameter is missing");
+    }
+    else {
+        std::string file
+            = CP::TRuntimeParameters::Get().GetParameterS(
+                "captChanInfo.wire.ignore.file");
+        const char* root = std::getenv("CAPTCHANINFOROOT");
+        if (!root) {
+            CaptError("Missing CAPTCHANINFOROOT environment variable");
+        }
+        else {
+            file = std::string(root) + "/parameters/" + file;
+            fValid = ReadFile(file, entries);
+            if (!fValid) CaptError("Unable to read " << file
+                                   << " (no wires will be ignored)");
+            else CaptLog("Read ignored wires from " << file);
+        }
+    }
+
+    Build(entries);
+}
+
+bool CP::TIgnoredWireList::ReadFile(const std::string& file,
+                                    std::vector<Entry>& entries) {
+    std::ifstream input(file.c_str());
+    if (!input.is_open()) return false;
+
+    std::string line;
+    while (std::getline(input,line)) {
+        line = line.substr(0,line.find("#"));
+        std::istringstream parseLine(line);
+        Entry entry;
+        parseLine >> entry.fPlane >> entry.fWire;
+        if (parseLine.fail()) continue;
+        entry.fFirstRun = INT_MIN;
+        entry.fLastRun = INT_MAX;
+        int run;
+        if (parseLine >> run) {
+            entry.fFirstRun = run;
+            if (parseLine >> run) entry.fLastRun = run;
+        }
+        if (entry.fLastRun < entry.fFirstRun) {
+            CaptError("Invalid run range for ignored wire: " << line);
+            continue;
+        }
+        entries.push_back(entry);
+    }
+    return true;
+}
+
+void CP::TIgnoredWireList::Build(const std::vector<Entry>& entries) {
+    // Find the runs where the list changes, and the number of wires.
+    fBoundaries.clear();
+    fWireCount = 0;
+    for (std::vector<Entry>::const_iterator e = entries.begin();
+         e != entries.end(); ++e) {
+        if (e->fPlane < 0 || kPlanes <= e->fPlane) continue;
+        if (e->fWire < 0) continue;
+        fWireCount = std::max(fWireCount, e->fWire+1);
+        if (e->fFirstRun != INT_MIN) fBoundaries.push_back(e->fFirstRun);
+        if (e->fLastRun != INT_MAX) fBoundaries.push_back(e->fLastRun+1);
+    }
+    std::sort(fBoundaries.begin(), fBoundaries.end());
+    fBoundaries.erase(std::unique(fBoundaries.begin(), fBoundaries.end()),
+                      fBoundaries.end());
+
+    fWordCount = (fWireCount + kWordBits - 1)/kWordBits;
+    fBits.assign(GetEpochCount()*kPlanes*fWordCount, 0);
+
+    // Set the bits for every epoch covered by each entry.
+    for (std::vector<Entry>::const_iterator e = entries.begin();
+         e != entries.end(); ++e) {
+        if (e->fPlane < 0 || kPlanes <= e->fPlane) continue;
+        if (e->fWire < 0) continue;
+        int first = GetEpoch(e->fFirstRun);
+        int last = GetEpoch(e->fLastRun);
+        Word bit = Word(1) << (e->fWire%kWordBits);
+        for (int epoch = first; epoch <= last; ++epoch) {
+            int word = (epoch*kPlanes + e->fPlane)*fWordCount
+                + e->fWire/kWordBits;
+            fBits[word] |= bit;
+        }
+    }
+}
+
+int CP::TIgnoredWireList::GetEpoch(int run) const {
+    return std::upper_bound(fBoundaries.begin(), fBoundaries.end(), run)
+        - fBoundaries.begin();
+}
+
+bool CP::TIgnoredWireList::IsIgnored(CP::TGeometryId id, int run) const {
+    if (!id.IsValid()) return false;
+    if (!CP::GeomId::Captain::IsWire(id)) return false;
+    return IsIgnored(CP::GeomId::Captain::GetWirePlane(id),
+                     CP::GeomId::Captain::GetWireNumber(id),
+                     run);
+}
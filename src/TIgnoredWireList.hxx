@@ -0,0 +1,109 @@
+#ifndef TIgnoredWireList_hxx_seen
+#define TIgnoredWireList_hxx_seen
+
+#include <TGeometryId.hxx>
+
+#include <string>
+#include <vector>
+
+namespace CP {
+    class TIgnoredWireList;
+};
+
+/// The list of wires that should be ignored in both data and MC.  The list
+/// is read from the file named by the captChanInfo.wire.ignore.file
+/// parameter (in the parameters directory of the package) the first time it
+/// is used, and is then fixed, so it can be used from any thread.  Each line
+/// of the file is
+///
+/// \code
+/// <plane> <wire> [<first-run> [<last-run>]]
+/// \endcode
+///
+/// where a wire without a run range is ignored for every run, a wire with
+/// only a first run is ignored from that run on, and a wire with both is
+/// ignored for the runs between first and last (inclusive).  The run ranges
+/// split the runs into epochs with a fixed set of ignored wires, and each
+/// epoch has a bitset of ignored wires for each plane.  The epoch for a run
+/// is found with a binary search, and checking a wire is a bit test.
+class CP::TIgnoredWireList {
+public:
+    /// Get the list.  The file is read the first time this is called.
+    static const CP::TIgnoredWireList& Get();
+
+    /// Check if a wire is ignored for a run.  Planes and wires outside of
+    /// the list are never ignored.
+    bool IsIgnored(int plane, int wire, int run) const {
+        return IsIgnoredInEpoch(plane, wire, GetEpoch(run));
+    }
+
+    /// Check if a wire geometry object is ignored for a run.  Geometry
+    /// objects that aren't wires are never ignored.
+    bool IsIgnored(CP::TGeometryId id, int run) const;
+
+    /// Get the epoch for a run.  All of the runs in the same epoch have the
+    /// same ignored wires.
+    int GetEpoch(int run) const;
+
+    /// Get the number of epochs.
+    int GetEpochCount() const {return fBoundaries.size() + 1;}
+
+    /// Check if a wire is ignored during an epoch.
+    bool IsIgnoredInEpoch(int plane, int wire, int epoch) const {
+        if (plane < 0 || kPlanes <= plane) return false;
+        if (wire < 0 || fWireCount <= wire) return false;
+        if (epoch < 0 || GetEpochCount() <= epoch) return false;
+        const Word* bits = &fBits[(epoch*kPlanes + plane)*fWordCount];
+        return (bits[wire/kWordBits] >> (wire%kWordBits)) & 1;
+    }
+
+    /// True if the list was read.  If the file couldn't be read, an error
+    /// is printed and no wires are ignored.
+    bool IsValid() const {return fValid;}
+
+private:
+    /// The type used to save the bits.
+    typedef unsigned long long Word;
+
+    /// The number of bits in a word, and the number of planes.
+    enum {kWordBits = 64, kPlanes = 3};
+
+    /// A wire that is ignored for a range of runs.
+    struct Entry {
+        int fPlane;
+        int fWire;
+        int fFirstRun;
+        int fLastRun;
+    };
+
+    /// Read the list from the file named by the parameters.
+    TIgnoredWireList();
+    TIgnoredWireList(const TIgnoredWireList&);
+    TIgnoredWireList& operator=(const TIgnoredWireList&);
+
+    /// Read the entries from a file.  This returns false if the file can't
+    /// be read.
+    static bool ReadFile(const std::string& file, std::vector<Entry>& entries);
+
+    /// Fill the epochs and bitsets from the entries.
+    void Build(const std::vector<Entry>& entries);
+
+    /// The instance.
+    static CP::TIgnoredWireList* fIgnoredWireList;
+
+    /// True if the list was read.
+    bool fValid;
+
+    /// The first run of each epoch after the first one, sorted.
+    std::vector<int> fBoundaries;
+
+    /// The number of wires covered in each plane.
+    int fWireCount;
+
+    /// The number of words for each plane.
+    int fWordCount;
+
+    /// The bits for each epoch and plane.
+    std::vector<Word> fBits;
+};
+#endif
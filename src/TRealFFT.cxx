@@ -0,0 +1,111 @@
+#include "TRealFFT.hxx"
+
+#include <cmath>
+
+CP::TRealFFT::TRealFFT(int size)
+    : fSize(size), fPower(1) {
+    if (fSize < 1) fSize = 1;
+
+    bool isPower = (fSize & (fSize-1)) == 0;
+    int minimum = isPower? fSize: 2*fSize - 1;
+    while (fPower < minimum) fPower *= 2;
+
+    fTwiddle.resize(fPower/2);
+    for (int i = 0; i < fPower/2; ++i) {
+        fTwiddle[i] = std::polar(1.0, -2.0*M_PI*i/fPower);
+    }
+
+    if (isPower) return;
+
+    // Prepare the Bluestein chirp.  The index k*k is reduced modulo 2*fSize
+    // so that the phase stays accurate for long transforms.
+    fChirp.resize(fSize);
+    for (long long k = 0; k < fSize; ++k) {
+        long long k2 = (k*k) % (2LL*fSize);
+        fChirp[k] = std::polar(1.0, -M_PI*k2/fSize);
+    }
+    fChirpKernel.assign(fPower, std::complex<double>(0.0,0.0));
+    fChirpKernel[0] = std::conj(fChirp[0]);
+    for (int k = 1; k < fSize; ++k) {
+        fChirpKernel[k] = std::conj(fChirp[k]);
+        fChirpKernel[fPower-k] = std::conj(fChirp[k]);
+    }
+    Radix2(fChirpKernel, false);
+}
+
+void CP::TRealFFT::Radix2(std::vector< std::complex<double> >& values,
+                          bool inverse) const {
+    int n = fPower;
+
+    // Reorder into bit reversed order.
+    for (int i = 1, j = 0; i < n; ++i) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(values[i], values[j]);
+    }
+
+    for (int length = 2; length <= n; length *= 2) {
+        int half = length/2;
+        int step = n/length;
+        for (int start = 0; start < n; start += length) {
+            for (int k = 0; k < half; ++k) {
+                std::complex<double> w = fTwiddle[k*step];
+                if (inverse) w = std::conj(w);
+                std::complex<double> u = values[start+k];
+                std::complex<double> v = values[start+k+half]*w;
+                values[start+k] = u + v;
+                values[start+k+half] = u - v;
+            }
+        }
+    }
+}
+
+void CP::TRealFFT::Transform(std::vector< std::complex<double> >& values,
+                             bool inverse) const {
+    if (fChirp.empty()) {
+        Radix2(values, inverse);
+        return;
+    }
+
+    // Bluestein's algorithm.  The inverse transform is done by conjugating
+    // the input and output of the forward transform.
+    std::vector< std::complex<double> > work(fPower,
+                                             std::complex<double>(0.0,0.0));
+    for (int k = 0; k < fSize; ++k) {
+        std::complex<double> v = inverse? std::conj(values[k]): values[k];
+        work[k] = v*fChirp[k];
+    }
+    Radix2(work, false);
+    for (int k = 0; k < fPower; ++k) work[k] *= fChirpKernel[k];
+    Radix2(work, true);
+    double norm = 1.0/fPower;
+    for (int k = 0; k < fSize; ++k) {
+        std::complex<double> v = work[k]*norm*fChirp[k];
+        values[k] = inverse? std::conj(v): v;
+    }
+}
+
+void CP::TRealFFT::Forward(const double* input,
+                           std::complex<double>* output) const {
+    std::vector< std::complex<double> > values(fSize);
+    for (int i = 0; i < fSize; ++i) {
+        values[i] = std::complex<double>(input[i], 0.0);
+    }
+    Transform(values, false);
+    for (int i = 0; i < GetSpectrumSize(); ++i) output[i] = values[i];
+}
+
+void CP::TRealFFT::Inverse(const std::complex<double>* input,
+                           double* output) const {
+    std::vector< std::complex<double> > values(fSize);
+    // Rebuild the full spectrum using the Hermitian symmetry of a real
+    // signal.
+    for (int i = 0; i < GetSpectrumSize(); ++i) values[i] = input[i];
+    for (int i = GetSpectrumSize(); i < fSize; ++i) {
+        values[i] = std::conj(input[fSize-i]);
+    }
+    Transform(values, true);
+    double norm = 1.0/fSize;
+    for (int i = 0; i < fSize; ++i) output[i] = values[i].real()*norm;
+}
@@ -0,0 +1,67 @@
+#ifndef TRealFFT_hxx_seen
+#define TRealFFT_hxx_seen
+
+#include <complex>
+#include <vector>
+
+namespace CP {
+    class TRealFFT;
+};
+
+/// A small FFT for real valued samples.  This is used to transform the
+/// response kernels in CP::TChannelCalib, and is local to this package so
+/// that it doesn't introduce a dependency on an external FFT library.  A
+/// transform of any length is supported.  Power of two lengths use an
+/// iterative radix-2 transform, and other lengths use the Bluestein chirp-z
+/// algorithm on top of the radix-2 transform.  The tables needed for a length
+/// are calculated when the object is constructed, so an object should be
+/// reused for many transforms of the same length.
+class CP::TRealFFT {
+public:
+    /// Prepare to transform "size" real values.
+    explicit TRealFFT(int size);
+
+    /// The number of real values transformed.
+    int GetSize() const {return fSize;}
+
+    /// The number of complex values in the spectrum.  This is size/2+1.
+    int GetSpectrumSize() const {return fSize/2 + 1;}
+
+    /// Transform GetSize() real values into GetSpectrumSize() complex
+    /// values.  The transform is not normalized.
+    void Forward(const double* input, std::complex<double>* output) const;
+
+    /// Transform GetSpectrumSize() complex values into GetSize() real
+    /// values.  The output is divided by GetSize(), so Inverse() undoes
+    /// Forward().
+    void Inverse(const std::complex<double>* input, double* output) const;
+
+private:
+    /// Do an in place complex transform of the values.  If inverse is true,
+    /// the sign of the exponent is flipped (no normalization is done).
+    void Transform(std::vector< std::complex<double> >& values,
+                   bool inverse) const;
+
+    /// Do an in place radix-2 transform with a length of fPower.
+    void Radix2(std::vector< std::complex<double> >& values,
+                bool inverse) const;
+
+    /// The number of real values.
+    int fSize;
+
+    /// The length of the radix-2 transform.  This is fSize if fSize is a
+    /// power of two, and otherwise is the padded length used by Bluestein.
+    int fPower;
+
+    /// The twiddle factors for the radix-2 transform.
+    std::vector< std::complex<double> > fTwiddle;
+
+    /// The Bluestein chirp, exp(-i*pi*k*k/fSize).  This is empty when fSize
+    /// is a power of two.
+    std::vector< std::complex<double> > fChirp;
+
+    /// The radix-2 transform of the conjugate chirp used as the Bluestein
+    /// convolution kernel.
+    std::vector< std::complex<double> > fChirpKernel;
+};
+#endif
@@ -0,0 +1,45 @@
+#include "TValidityRange.hxx"
+
+#include <TDbiValidityRec.hxx>
+#include <TVldRange.hxx>
+#include <TVldTimeStamp.hxx>
+
+CP::TValidityRange::TValidityRange()
+    : fValid(false), fPartition(0), fMC(false), fRun(-1),
+      fHasTimeRange(false), fStart(0), fEnd(0) {}
+
+void CP::TValidityRange::Reset(const CP::TEventContext& context) {
+    fValid = context.IsValid();
+    fPartition = context.GetPartition();
+    fMC = context.IsMC();
+    fRun = context.GetRun();
+    fHasTimeRange = false;
+    fStart = 0;
+    fEnd = 0;
+}
+
+void CP::TValidityRange::Restrict(const CP::TDbiValidityRec* vrec) {
+    if (!vrec) return;
+    std::time_t start = vrec->GetTimeRange().GetTimeStart().GetSec();
+    std::time_t end = vrec->GetTimeRange().GetTimeEnd().GetSec();
+    if (!fHasTimeRange) {
+        fHasTimeRange = true;
+        fStart = start;
+        fEnd = end;
+        return;
+    }
+    if (fStart < start) fStart = start;
+    if (end < fEnd) fEnd = end;
+}
+
+bool CP::TValidityRange::Contains(const CP::TEventContext& context) const {
+    if (!fValid) return false;
+    if (!context.IsValid()) return false;
+    if (context.GetPartition() != fPartition) return false;
+    if (context.IsMC() != fMC) return false;
+    if (!fHasTimeRange) return context.GetRun() == fRun;
+    std::time_t t = context.GetTimeStamp();
+    if (t < fStart) return false;
+    if (fEnd <= t) return false;
+    return true;
+}
@@ -0,0 +1,71 @@
+#ifndef TValidityRange_hxx_seen
+#define TValidityRange_hxx_seen
+
+#include <TEventContext.hxx>
+
+#include <ctime>
+
+namespace CP {
+    class TValidityRange;
+    class TDbiValidityRec;
+};
+
+/// The range of event contexts for which a set of values loaded from the
+/// database stay valid.  The range is started for a particular context using
+/// Reset(), and is then narrowed to the validity range of each table that
+/// was used using Restrict().  If no table provides a validity range (e.g. a
+/// table is missing), then the range covers the run of the context that
+/// started it.  This is used to decide if cached database values need to be
+/// reloaded when the event context changes.
+class CP::TValidityRange {
+public:
+    TValidityRange();
+
+    /// Start a new range for the context.  Until Restrict() is called, the
+    /// range covers events in the same partition and run as the context.
+    void Reset(const CP::TEventContext& context);
+
+    /// Narrow the range to the time range of a database validity record.
+    /// This should be called for each table that contributes to the cached
+    /// values.  A NULL record is ignored.
+    void Restrict(const CP::TDbiValidityRec* vrec);
+
+    /// Mark the range as empty so that no context is contained.
+    void Invalidate() {fValid = false;}
+
+    /// Check if the range has been set.
+    bool IsValid() const {return fValid;}
+
+    /// Check if the event context is inside of the range.
+    bool Contains(const CP::TEventContext& context) const;
+
+    /// Get the first time (inclusive) in the range.
+    std::time_t GetStart() const {return fStart;}
+
+    /// Get the last time (exclusive) in the range.
+    std::time_t GetEnd() const {return fEnd;}
+
+private:
+    /// True if the range has been set.
+    bool fValid;
+
+    /// The partition of the context that started the range.
+    int fPartition;
+
+    /// True if the range is for an MC context.
+    bool fMC;
+
+    /// The run of the context that started the range.  This is only used if
+    /// there isn't a time range from the database.
+    int fRun;
+
+    /// True if a time range has been provided by a validity record.
+    bool fHasTimeRange;
+
+    /// The start of the time range.
+    std::time_t fStart;
+
+    /// The end of the time range.
+    std::time_t fEnd;
+};
+#endif
@@ -0,0 +1,51 @@
+#include "TWireAdjacency.hxx"
+#include "TChannelMap.hxx"
+#include "TGeometryInfo.hxx"
+#include "TIgnoredWireList.hxx"
+
+#include <CaptGeomId.hxx>
+#include <TMCChannelId.hxx>
+
+CP::TWireAdjacency::TWireAdjacency() : fRun(-1) {}
+
+void CP::TWireAdjacency::Build(const CP::TChannelMap& channelMap, int run) {
+    fRun = run;
+    const CP::TIgnoredWireList& ignored = CP::TIgnoredWireList::Get();
+    int epoch = ignored.GetEpoch(run);
+    bool mc = channelMap.GetContext().IsMC();
+    const CP::TChannelMap::Record* first = NULL;
+    if (channelMap.GetRecordCount() > 0) first = &channelMap.GetRecord(0);
+
+    for (int plane = 0; plane < kPlanes; ++plane) {
+        int wires = CP::TGeometryInfo::Get().GetWireCount(plane);
+        if (wires < 0) wires = 0;
+        fChannels[plane].assign(wires, CP::TChannelId());
+        fRecords[plane].assign(wires, -1);
+        fGood[plane].assign(wires, 0);
+        for (int wire = 0; wire < wires; ++wire) {
+            if (mc) {
+                fChannels[plane][wire] = CP::TMCChannelId(0,plane,wire);
+            }
+            else {
+                const CP::TChannelMap::Record* record
+                    = channelMap.FindGeometry(
+                        CP::GeomId::Captain::Wire(plane,wire));
+                if (!record) continue;
+                fChannels[plane][wire] = record->GetChannelId();
+                fRecords[plane][wire] = record - first;
+            }
+            if (ignored.IsIgnoredInEpoch(plane, wire, epoch)) continue;
+            fGood[plane][wire] = 1;
+        }
+    }
+}
+
+std::size_t CP::TWireAdjacency::GetMemoryUsage() const {
+    std::size_t size = sizeof(*this);
+    for (int i = 0; i<kPlanes; ++i) {
+        size += fChannels[i].capacity()*sizeof(CP::TChannelId);
+        size += fRecords[i].capacity()*sizeof(int);
+        size += fGood[i].capacity()*sizeof(unsigned char);
+    }
+    return size;
+}
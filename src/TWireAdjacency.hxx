@@ -0,0 +1,110 @@
+#ifndef TWireAdjacency_hxx_seen
+#define TWireAdjacency_hxx_seen
+
+#include <TChannelId.hxx>
+
+#include <vector>
+
+namespace CP {
+    class TWireAdjacency;
+    class TChannelMap;
+};
+
+/// The channels for the wires in each plane, ordered by the wire number in
+/// the plane (the number in the geometry identifier, not the wire number
+/// around the TPC).  For each wire, this holds the channel, the position of
+/// the channel record in the CP::TChannelMap, and whether the wire is good
+/// (see CP::TChannelCalib::IsGoodWire()).  Since the wires are in order, the
+/// neighbours of a wire are found with a pointer offset, so clustering can
+/// scan a plane without translating identifiers.
+///
+/// \code
+/// std::shared_ptr<const CP::TWireAdjacency> adjacency
+///     = CP::TChannelInfo::Get().GetWireAdjacency(event.GetContext());
+/// const CP::TChannelId* channels = adjacency->GetChannels(plane);
+/// const unsigned char* good = adjacency->GetGoodWires(plane);
+/// for (int k = -2; k <= 2; ++k) {
+///     if (wire+k < 0 || adjacency->GetWireCount(plane) <= wire+k) continue;
+///     if (good[wire+k]) Use(channels[wire+k]);
+/// }
+/// \endcode
+///
+/// The adjacency is created by CP::TChannelInfo for a channel map and run,
+/// and is not changed after it has been built.
+class CP::TWireAdjacency {
+public:
+    /// The number of wire planes.
+    enum {kPlanes = 3};
+
+    TWireAdjacency();
+
+    /// Build the adjacency for a channel map and a run.  The number of
+    /// wires in each plane is taken from CP::TGeometryInfo, so the geometry
+    /// must be loaded.  For MC maps, the channels are generated from the
+    /// wire, and don't have a record.
+    void Build(const CP::TChannelMap& channelMap, int run);
+
+    /// Get the run used to decide which wires are good.
+    int GetRun() const {return fRun;}
+
+    /// Get the number of wires in a plane.
+    int GetWireCount(int plane) const {
+        if (plane < 0 || kPlanes <= plane) return 0;
+        return fChannels[plane].size();
+    }
+
+    /// Get the channel for a wire.  This is an invalid identifier if the
+    /// wire isn't connected, or is outside of the plane.
+    CP::TChannelId GetChannel(int plane, int wire) const {
+        if (wire < 0 || GetWireCount(plane) <= wire) return CP::TChannelId();
+        return fChannels[plane][wire];
+    }
+
+    /// Get the position of the channel record (see
+    /// CP::TChannelMap::GetRecord()) for a wire, or -1.
+    int GetRecord(int plane, int wire) const {
+        if (wire < 0 || GetWireCount(plane) <= wire) return -1;
+        return fRecords[plane][wire];
+    }
+
+    /// Check if a wire is good.  Wires outside of the plane are not good.
+    bool IsGoodWire(int plane, int wire) const {
+        if (wire < 0 || GetWireCount(plane) <= wire) return false;
+        return fGood[plane][wire];
+    }
+
+    /// \name Arrays for a plane
+    /// The arrays have GetWireCount(plane) entries indexed by the wire
+    /// number, and are NULL if the plane doesn't have any wires.
+    /// @{
+    const CP::TChannelId* GetChannels(int plane) const {
+        if (GetWireCount(plane) < 1) return NULL;
+        return &fChannels[plane][0];
+    }
+    const int* GetRecords(int plane) const {
+        if (GetWireCount(plane) < 1) return NULL;
+        return &fRecords[plane][0];
+    }
+    const unsigned char* GetGoodWires(int plane) const {
+        if (GetWireCount(plane) < 1) return NULL;
+        return &fGood[plane][0];
+    }
+    /// @}
+
+    /// Get the approximate amount of memory used in bytes.
+    std::size_t GetMemoryUsage() const;
+
+private:
+    /// The run used to decide which wires are good.
+    int fRun;
+
+    /// The channel for each wire in a plane.
+    std::vector<CP::TChannelId> fChannels[kPlanes];
+
+    /// The channel record for each wire in a plane, or -1.
+    std::vector<int> fRecords[kPlanes];
+
+    /// One if the wire is good, and zero otherwise.
+    std::vector<unsigned char> fGood[kPlanes];
+};
+#endif